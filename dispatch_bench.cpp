@@ -0,0 +1,565 @@
+/*********************************************************************************************************************
+ *
+ * dispatch_bench.cpp
+ *
+ * Cpp_design_patterns
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+// Benchmark of the different ways to dispatch on the shape type used in this repository:
+//  - double dispatch (visitor_classic.cpp)
+//  - std::visit (visitor_modern.cpp)
+//  - external polymorphism (external_polymorphism.cpp)
+//  - type erasure (type_erasure.cpp), with a virtual Concept or with a manual vtable
+//  - virtual function (factory_simple.cpp)
+// Each approach computes the total area of the same shapes, either shuffled or sorted by type,
+// and reports the time per shape, the memory allocated per shape and the number of allocations.
+//
+// Usage: Dispatch_bench [max number of shapes]
+// (default: up to 100M shapes, which needs several GB of memory; build in Release for meaningful numbers)
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <variant>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <numbers>
+#include <string>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                               ALLOCATION COUNTING                                           |
++------------------------------------------------------------------------------------------------------------*/
+
+// replaces the global operator new to count allocations (single threaded benchmark).
+// noinline: once inlined, GCC sees malloc/free paired with new/delete and warns (-Wmismatched-new-delete)
+std::size_t g_nbAllocations = 0;
+std::size_t g_allocatedBytes = 0;
+
+[[gnu::noinline]] void* operator new(std::size_t _size)
+{
+    ++g_nbAllocations;
+    g_allocatedBytes += _size;
+    if (void* ptr = std::malloc(_size ? _size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* _ptr) noexcept { std::free(_ptr); }
+[[gnu::noinline]] void operator delete(void* _ptr, std::size_t) noexcept { std::free(_ptr); }
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                    WORKLOAD                                                 |
++------------------------------------------------------------------------------------------------------------*/
+
+struct Point
+{
+    double x;
+    double y;
+};
+
+enum class TypeShape
+{
+    circle,
+    square
+};
+
+// description of a shape, converted into each approach's own shape types
+struct ShapeDesc
+{
+    TypeShape type;
+    Point center;
+    double size;  // radius or side
+};
+
+// random mix of Circles and Squares, optionally sorted by type
+std::vector<ShapeDesc> makeWorkload(std::size_t _nbShapes, bool _sortedByType)
+{
+    std::mt19937 gen(42);
+    std::bernoulli_distribution isCircle(0.5);
+    std::uniform_real_distribution<double> coord(-100.0, 100.0);
+    std::uniform_real_distribution<double> size(0.1, 10.0);
+
+    std::vector<ShapeDesc> descs;
+    descs.reserve(_nbShapes);
+    for (std::size_t i = 0; i < _nbShapes; ++i) {
+        descs.push_back({ isCircle(gen) ? TypeShape::circle : TypeShape::square, { coord(gen), coord(gen) }, size(gen) });
+    }
+
+    if (_sortedByType) {
+        std::stable_partition(descs.begin(), descs.end(), [](ShapeDesc const& _d) { return _d.type == TypeShape::circle; });
+    }
+    return descs;
+}
+
+double circleArea(double _radius) { return std::numbers::pi * _radius * _radius; }
+double squareArea(double _side) { return _side * _side; }
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                             DOUBLE DISPATCH (CLASSIC)                                       |
++------------------------------------------------------------------------------------------------------------*/
+
+namespace classic
+{
+    class Circle;
+    class Square;
+
+    class ShapeVisitor
+    {
+    public:
+        virtual ~ShapeVisitor() = default;
+        virtual void visit(Circle const&) const = 0;
+        virtual void visit(Square const&) const = 0;
+    };
+
+    class Shape
+    {
+    public:
+        explicit Shape(Point _center) : m_center(_center) {}
+        virtual ~Shape() = default;
+        virtual void accept(ShapeVisitor const& _v) const = 0;
+    protected:
+        Point m_center;
+    };
+
+    class Circle : public Shape
+    {
+    public:
+        explicit Circle(Point _center, double _radius) : Shape(_center), m_radius(_radius) {}
+        void accept(ShapeVisitor const& _v) const override { _v.visit(*this); }
+        double radius() const { return m_radius; }
+    private:
+        double m_radius;
+    };
+
+    class Square : public Shape
+    {
+    public:
+        explicit Square(Point _center, double _side) : Shape(_center), m_side(_side) {}
+        void accept(ShapeVisitor const& _v) const override { _v.visit(*this); }
+        double side() const { return m_side; }
+    private:
+        double m_side;
+    };
+
+    // accumulates the areas of the visited shapes
+    class AreaVisitor : public ShapeVisitor
+    {
+    public:
+        explicit AreaVisitor(double& _total) : m_total(&_total) {}
+        void visit(Circle const& _circle) const override { *m_total += circleArea(_circle.radius()); }
+        void visit(Square const& _square) const override { *m_total += squareArea(_square.side()); }
+    private:
+        double* m_total;
+    };
+
+    using Shapes = std::vector< std::unique_ptr<Shape> >;
+
+    Shapes build(std::vector<ShapeDesc> const& _descs)
+    {
+        Shapes shapes;
+        shapes.reserve(_descs.size());
+        for (auto const& d : _descs)
+        {
+            if (d.type == TypeShape::circle) { shapes.push_back(std::make_unique<Circle>(d.center, d.size)); }
+            else { shapes.push_back(std::make_unique<Square>(d.center, d.size)); }
+        }
+        return shapes;
+    }
+
+    double totalArea(Shapes const& _shapes)
+    {
+        double total = 0.0;
+        AreaVisitor visitor(total);
+        for (auto const& shape : _shapes) {
+            shape->accept(visitor);
+        }
+        return total;
+    }
+}
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                               STD::VISIT (MODERN)                                           |
++------------------------------------------------------------------------------------------------------------*/
+
+namespace modern
+{
+    struct Circle { Point center; double radius; };
+    struct Square { Point center; double side; };
+
+    struct AreaVisitor
+    {
+        double operator()(Circle const& _circle) const { return circleArea(_circle.radius); }
+        double operator()(Square const& _square) const { return squareArea(_square.side); }
+    };
+
+    using Shape = std::variant<Circle, Square>;
+    using Shapes = std::vector<Shape>;
+
+    Shapes build(std::vector<ShapeDesc> const& _descs)
+    {
+        Shapes shapes;
+        shapes.reserve(_descs.size());
+        for (auto const& d : _descs)
+        {
+            if (d.type == TypeShape::circle) { shapes.emplace_back(Circle{ d.center, d.size }); }
+            else { shapes.emplace_back(Square{ d.center, d.size }); }
+        }
+        return shapes;
+    }
+
+    double totalArea(Shapes const& _shapes)
+    {
+        double total = 0.0;
+        for (auto const& shape : _shapes) {
+            total += std::visit(AreaVisitor(), shape);
+        }
+        return total;
+    }
+}
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                              EXTERNAL POLYMORPHISM                                          |
++------------------------------------------------------------------------------------------------------------*/
+
+namespace external
+{
+    struct Circle { Point center; double radius; };
+    struct Square { Point center; double side; };
+
+    double area_ft(Circle const& _circle) { return circleArea(_circle.radius); }
+    double area_ft(Square const& _square) { return squareArea(_square.side); }
+
+    class ShapeConcept
+    {
+    public:
+        virtual ~ShapeConcept() = default;
+        virtual double area() const = 0;
+    };
+
+    template< typename ShapeT >
+    class ShapeModel : public ShapeConcept
+    {
+    public:
+        explicit ShapeModel(ShapeT _shape) : m_shape(_shape) {}
+        double area() const override { return area_ft(m_shape); }
+    private:
+        ShapeT m_shape;
+    };
+
+    using Shapes = std::vector< std::unique_ptr<ShapeConcept> >;
+
+    Shapes build(std::vector<ShapeDesc> const& _descs)
+    {
+        Shapes shapes;
+        shapes.reserve(_descs.size());
+        for (auto const& d : _descs)
+        {
+            if (d.type == TypeShape::circle) { shapes.push_back(std::make_unique< ShapeModel<Circle> >(Circle{ d.center, d.size })); }
+            else { shapes.push_back(std::make_unique< ShapeModel<Square> >(Square{ d.center, d.size })); }
+        }
+        return shapes;
+    }
+
+    double totalArea(Shapes const& _shapes)
+    {
+        double total = 0.0;
+        for (auto const& shape : _shapes) {
+            total += shape->area();
+        }
+        return total;
+    }
+}
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                  TYPE ERASURE                                               |
++------------------------------------------------------------------------------------------------------------*/
+
+namespace erasure
+{
+    struct Circle { Point center; double radius; };
+    struct Square { Point center; double side; };
+
+    struct AreaStrategy
+    {
+        double operator()(Circle const& _circle) const { return circleArea(_circle.radius); }
+        double operator()(Square const& _square) const { return squareArea(_square.side); }
+    };
+
+    class Shape
+    {
+    public:
+        template< typename ShapeT, typename AreaStrategyT >
+        Shape(ShapeT const& _shape, AreaStrategyT const& _area)
+            : m_pImpl{ std::make_unique< Model<ShapeT, AreaStrategyT> >(_shape, _area) }
+        {}
+
+        double area() const { return m_pImpl->area(); }
+
+    private:
+        struct Concept
+        {
+            virtual ~Concept() = default;
+            virtual double area() const = 0;
+        };
+
+        template< typename ShapeT, typename AreaStrategyT >
+        struct Model : public Concept
+        {
+            explicit Model(ShapeT _shape, AreaStrategyT _area) : m_shape(_shape), m_area(_area) {}
+            double area() const override { return m_area(m_shape); }
+            ShapeT m_shape;
+            AreaStrategyT m_area;
+        };
+
+        std::unique_ptr<Concept> m_pImpl;
+    };
+
+    // manual vtable: same layout as ManualVtableShape in type_erasure.cpp (handle with the hot operation
+    // stored inline, static table with clone and destroy), with area() as the hot operation instead of print()
+    class ManualShape
+    {
+    public:
+        template< typename ShapeT, typename AreaStrategyT >
+        ManualShape(ShapeT const& _shape, AreaStrategyT const& _area)
+            : m_area{ vtable< Model<ShapeT, AreaStrategyT> >.area }
+            , m_vtable{ &vtable< Model<ShapeT, AreaStrategyT> > }
+            , m_pImpl{ new Model<ShapeT, AreaStrategyT>{ _shape, _area } }
+        {}
+
+        ManualShape(ManualShape const& _other)
+            : m_area{ _other.m_area }, m_vtable{ _other.m_vtable }, m_pImpl{ _other.m_vtable->clone(_other.m_pImpl) }
+        {}
+
+        ManualShape(ManualShape&& _other) noexcept
+            : m_area{ _other.m_area }, m_vtable{ _other.m_vtable }, m_pImpl{ _other.m_pImpl }
+        {
+            _other.m_pImpl = nullptr;
+        }
+
+        ManualShape& operator=(ManualShape const& _other)
+        {
+            ManualShape tmp(_other);
+            swap(tmp);
+            return *this;
+        }
+
+        ManualShape& operator=(ManualShape&& _other) noexcept
+        {
+            ManualShape tmp(std::move(_other));
+            swap(tmp);
+            return *this;
+        }
+
+        ~ManualShape()
+        {
+            if (m_pImpl != nullptr) {
+                m_vtable->destroy(m_pImpl);
+            }
+        }
+
+        double area() const { return m_area(m_pImpl); }
+
+    private:
+        template< typename ShapeT, typename AreaStrategyT >
+        struct Model
+        {
+            ShapeT m_shape;
+            AreaStrategyT m_area;
+        };
+
+        struct VTable
+        {
+            double (*area)(void const*);
+            void*  (*clone)(void const*);
+            void   (*destroy)(void*) noexcept;
+        };
+
+        template< typename M >
+        static constexpr VTable vtable = {
+            [](void const* _model) { return static_cast<M const*>(_model)->m_area(static_cast<M const*>(_model)->m_shape); },
+            [](void const* _model) -> void* { return new M(*static_cast<M const*>(_model)); },
+            [](void* _model) noexcept { delete static_cast<M*>(_model); }
+        };
+
+        void swap(ManualShape& _other) noexcept
+        {
+            std::swap(m_area, _other.m_area);
+            std::swap(m_vtable, _other.m_vtable);
+            std::swap(m_pImpl, _other.m_pImpl);
+        }
+
+        double (*m_area)(void const*);
+        VTable const* m_vtable;
+        void* m_pImpl;
+    };
+
+    template< typename ShapeType >
+    std::vector<ShapeType> build(std::vector<ShapeDesc> const& _descs)
+    {
+        std::vector<ShapeType> shapes;
+        shapes.reserve(_descs.size());
+        for (auto const& d : _descs)
+        {
+            if (d.type == TypeShape::circle) { shapes.emplace_back(Circle{ d.center, d.size }, AreaStrategy()); }
+            else { shapes.emplace_back(Square{ d.center, d.size }, AreaStrategy()); }
+        }
+        return shapes;
+    }
+
+    template< typename ShapeType >
+    double totalArea(std::vector<ShapeType> const& _shapes)
+    {
+        double total = 0.0;
+        for (auto const& shape : _shapes) {
+            total += shape.area();
+        }
+        return total;
+    }
+}
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                VIRTUAL FUNCTION                                             |
++------------------------------------------------------------------------------------------------------------*/
+
+namespace virtual_fn
+{
+    class Shape
+    {
+    public:
+        explicit Shape(Point _center) : m_center(_center) {}
+        virtual ~Shape() = default;
+        virtual double area() const = 0;
+    protected:
+        Point m_center;
+    };
+
+    class Circle : public Shape
+    {
+    public:
+        explicit Circle(Point _center, double _radius) : Shape(_center), m_radius(_radius) {}
+        double area() const override { return circleArea(m_radius); }
+    private:
+        double m_radius;
+    };
+
+    class Square : public Shape
+    {
+    public:
+        explicit Square(Point _center, double _side) : Shape(_center), m_side(_side) {}
+        double area() const override { return squareArea(m_side); }
+    private:
+        double m_side;
+    };
+
+    using Shapes = std::vector< std::unique_ptr<Shape> >;
+
+    Shapes build(std::vector<ShapeDesc> const& _descs)
+    {
+        Shapes shapes;
+        shapes.reserve(_descs.size());
+        for (auto const& d : _descs)
+        {
+            if (d.type == TypeShape::circle) { shapes.push_back(std::make_unique<Circle>(d.center, d.size)); }
+            else { shapes.push_back(std::make_unique<Square>(d.center, d.size)); }
+        }
+        return shapes;
+    }
+
+    double totalArea(Shapes const& _shapes)
+    {
+        double total = 0.0;
+        for (auto const& shape : _shapes) {
+            total += shape->area();
+        }
+        return total;
+    }
+}
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                      MAIN                                                   |
++------------------------------------------------------------------------------------------------------------*/
+
+// prevents the compiler from removing the computations
+double g_checksum = 0.0;
+
+// builds the shapes of one approach, then measures the time needed to compute their total area
+template< typename Build, typename TotalArea >
+void runBench(char const* _approach, char const* _input, std::vector<ShapeDesc> const& _descs,
+              Build _build, TotalArea _totalArea)
+{
+    const std::size_t nbShapes = _descs.size();
+
+    const std::size_t allocationsBefore = g_nbAllocations;
+    const std::size_t bytesBefore = g_allocatedBytes;
+    auto shapes = _build(_descs);
+    const std::size_t nbAllocations = g_nbAllocations - allocationsBefore;
+    const std::size_t nbBytes = g_allocatedBytes - bytesBefore;
+
+    // small inputs are repeated, so that each measure covers at least ~10M shapes
+    const std::size_t nbRuns = std::max<std::size_t>(1, 10'000'000 / nbShapes);
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t run = 0; run < nbRuns; ++run) {
+        g_checksum += _totalArea(shapes);
+    }
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::left << std::setw(24) << _approach << std::setw(10) << _input
+              << std::right << std::setw(12) << nbShapes
+              << std::fixed << std::setprecision(2)
+              << std::setw(12) << ns / double(nbRuns * nbShapes)
+              << std::setw(14) << double(nbBytes) / double(nbShapes)
+              << std::setw(12) << nbAllocations << std::endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    std::size_t maxShapes = 100'000'000;
+    if (argc > 1) {
+        maxShapes = std::strtoull(argv[1], nullptr, 10);
+    }
+
+    std::cout << std::left << std::setw(24) << "approach" << std::setw(10) << "input"
+              << std::right << std::setw(12) << "shapes" << std::setw(12) << "ns/shape"
+              << std::setw(14) << "bytes/shape" << std::setw(12) << "allocs" << std::endl;
+
+    for (std::size_t nbShapes : { 1'000ull, 1'000'000ull, 100'000'000ull })
+    {
+        if (nbShapes > maxShapes) {
+            break;
+        }
+
+        for (bool sorted : { false, true })
+        {
+            const char* input = sorted ? "sorted" : "shuffled";
+            const std::vector<ShapeDesc> descs = makeWorkload(nbShapes, sorted);
+
+            runBench("double dispatch", input, descs, classic::build, classic::totalArea);
+            runBench("std::visit", input, descs, modern::build, modern::totalArea);
+            runBench("external polymorphism", input, descs, external::build, external::totalArea);
+            runBench("type erasure", input, descs, erasure::build<erasure::Shape>, erasure::totalArea<erasure::Shape>);
+            runBench("manual vtable", input, descs, erasure::build<erasure::ManualShape>, erasure::totalArea<erasure::ManualShape>);
+            runBench("virtual function", input, descs, virtual_fn::build, virtual_fn::totalArea);
+        }
+    }
+
+    std::cout << "(checksum: " << g_checksum << ")" << std::endl;
+
+    return EXIT_SUCCESS;
+}
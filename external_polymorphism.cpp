@@ -10,6 +10,16 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <memory>
+#include <typeindex>
+#include <unordered_map>
+#include <type_traits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <limits>
+#include <thread>
 # define _USE_MATH_DEFINES
 #include <math.h>
 
@@ -102,7 +112,7 @@ public:
         : m_shape(_shape)
     {}
 
-    void print() const {
+    void print() const final {
         print_ft(m_shape); // call appropriate print function depending on Shape Type
     }
 
@@ -111,6 +121,71 @@ private:
 };
 
 
+/*------------------------------------------------------------------------------------------------------------+
+|                                                  SHAPEFORMATTER                                             |
++------------------------------------------------------------------------------------------------------------*/
+
+// Formatting engine of PrintStrategy: appends the text of a shape to a string with std::to_chars,
+// without any stream or global state, so it can be used from several threads with deterministic output
+class ShapeFormatter
+{
+public:
+    explicit ShapeFormatter(bool _useCap, bool _showDecimals)
+        : m_layout(&layouts[_useCap][_showDecimals])
+    {}
+
+    void format(Circle const& _circle, std::string& _out) const
+    {
+        _out += m_layout->circlePrefix;
+        appendPoint(_circle.center(), _out);
+        _out += "), radius = ";
+        appendNumber(_circle.radius(), _out);
+        _out += '\n';
+    }
+
+    void format(Square const& _square, std::string& _out) const
+    {
+        _out += m_layout->squarePrefix;
+        appendPoint(_square.center(), _out);
+        _out += "), side = ";
+        appendNumber(_square.side(), _out);
+        _out += '\n';
+    }
+
+private:
+
+    // precomputed layout of each (useCap, showDecimals) configuration
+    struct Layout
+    {
+        std::string_view circlePrefix;
+        std::string_view squarePrefix;
+        int precision;
+    };
+
+    static constexpr Layout layouts[2][2] = {
+        { { "circle: center = (", "square: center = (", 0 }, { "circle: center = (", "square: center = (", 2 } },
+        { { "CIRCLE: center = (", "SQUARE: center = (", 0 }, { "CIRCLE: center = (", "SQUARE: center = (", 2 } }
+    };
+
+    void appendPoint(Point _point, std::string& _out) const
+    {
+        appendNumber(_point.x, _out);
+        _out += ", ";
+        appendNumber(_point.y, _out);
+    }
+
+    // same output as std::fixed with std::setprecision(precision)
+    void appendNumber(double _value, std::string& _out) const
+    {
+        char buffer[std::numeric_limits<double>::max_exponent10 + 32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), _value, std::chars_format::fixed, m_layout->precision);
+        _out.append(buffer, result.ptr);
+    }
+
+    Layout const* m_layout;
+};
+
+
 /*------------------------------------------------------------------------------------------------------------+
 |                                                   SHAPEMODEL V2                                             |
 +------------------------------------------------------------------------------------------------------------*/
@@ -124,7 +199,7 @@ public:
         : m_shape(_shape), m_print(_print)
     {}
 
-    void print() const {
+    void print() const final {
         m_print(m_shape); // use provided print strategy
     }
 
@@ -135,44 +210,257 @@ private:
 
 
 // Collection of print functions, with different options
+// (does not change the state of std::cout: safe to use from several threads)
 class PrintStrategy
 {
 public:
     explicit PrintStrategy(bool _useCap, bool _showDecimals)
-        : m_useCap(_useCap), m_showDecimal(_showDecimals)
+        : m_formatter(_useCap, _showDecimals)
     {}
 
     void operator()(Circle const& _circle) const
     {
-        if (m_useCap) { std::cout << "CIRCLE: "; }
-        else { std::cout << "circle: "; }
+        write(_circle);
+    }
+
+    void operator()(Square const& _square) const
+    {
+        write(_square);
+    }
+
+private:
+
+    // formats the whole line first, then writes it at once
+    template< typename ShapeT >
+    void write(ShapeT const& _shape) const
+    {
+        thread_local std::string line;  // reused: no allocation once large enough
+        line.clear();
+        m_formatter.format(_shape, line);
+        std::cout.write(line.data(), std::streamsize(line.size()));
+    }
 
-        if (m_showDecimal) { std::cout << std::setprecision(2) << std::fixed; }
-        else { std::cout << std::setprecision(0) << std::fixed; }
+    ShapeFormatter m_formatter;
+};
 
-        std::cout << "center = (" << _circle.center().x << ", " << _circle.center().y
-            << "), radius = " << _circle.radius() << std::endl;
 
+/*------------------------------------------------------------------------------------------------------------+
+|                                                 SHAPEREFMODELS                                              |
++------------------------------------------------------------------------------------------------------------*/
+
+// Default print behavior of the borrowing models: the print_ft functions (as ShapeModelv1)
+struct PrintFt
+{
+    template< typename ShapeT >
+    void operator()(ShapeT const& _shape) const { print_ft(_shape); }
+};
+
+// Borrowing version of ShapeModelv1/v2: references a shape owned elsewhere instead of copying it
+// (the shape must outlive the model)
+template< typename ShapeT, typename PrintStrategy = PrintFt >
+class ShapeRefModel : public ShapeConcept
+{
+public:
+    explicit ShapeRefModel(ShapeT const& _shape, PrintStrategy _print = PrintStrategy())
+        : m_shape(&_shape), m_print(_print)
+    {}
+
+    void print() const final {
+        m_print(*m_shape);
     }
 
-    void operator()(Square const& _square) const
+private:
+    ShapeT const* m_shape;
+    PrintStrategy m_print;
+};
+
+// A whole array of shapes owned elsewhere, seen as a single ShapeConcept
+// (adds the behavior to all of them without duplicating them; the array must outlive the model)
+template< typename ShapeT, typename PrintStrategy = PrintFt >
+class ShapeSpanModel : public ShapeConcept
+{
+public:
+    explicit ShapeSpanModel(std::span<const ShapeT> _shapes, PrintStrategy _print = PrintStrategy())
+        : m_shapes(_shapes), m_print(_print)
+    {}
+
+    void print() const final {
+        for (ShapeT const& shape : m_shapes) {
+            m_print(shape);
+        }
+    }
+
+    std::size_t size() const { return m_shapes.size(); }
+
+private:
+    std::span<const ShapeT> m_shapes;
+    PrintStrategy m_print;
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                 SEGMENTEDSHAPES                                             |
++------------------------------------------------------------------------------------------------------------*/
+
+// Polymorphic collection of ShapeConcept models, with one contiguous segment (std::vector) per concrete model type
+// instead of one allocation per model.
+// Typed for_each<ModelT>() loops over a single segment with direct calls (models are final: no virtual dispatch),
+// untyped for_each() goes through all the segments (segment by segment, in order of first insertion).
+class SegmentedShapes
+{
+public:
+
+    // constructs a model at the end of its segment
+    // (like with std::vector, references to the models of this segment may be invalidated)
+    template< typename ModelT, typename... Args >
+    ModelT& emplace(Args&&... _args)
     {
-        if (m_useCap) { std::cout << "SQUARE: "; }
-        else { std::cout << "square: "; }
+        return segment<ModelT>().m_models.emplace_back(std::forward<Args>(_args)...);
+    }
 
-        if (m_showDecimal) { std::cout << std::setprecision(2) << std::fixed; }
-        else { std::cout << std::setprecision(0) << std::fixed; }
+    // calls _fn(ModelT const&) on all the models of type ModelT
+    template< typename ModelT, typename Fn >
+    void for_each(Fn&& _fn) const
+    {
+        auto it = m_segmentsByType.find(typeid(ModelT));
+        if (it == m_segmentsByType.end()) {
+            return;
+        }
+        for (ModelT const& model : static_cast<Segment<ModelT> const*>(it->second)->m_models) {
+            _fn(model);
+        }
+    }
 
-        std::cout << "center = (" << _square.center().x << ", " << _square.center().y
-                  << "), side = " << _square.side() << std::endl;
+    // calls _fn(ShapeConcept const&) on all the models
+    template< typename Fn >
+    void for_each(Fn&& _fn) const
+    {
+        for (auto const& segment : m_segments) {
+            segment->for_each([](ShapeConcept const& _shape, void* _fnPtr) { (*static_cast<Fn*>(_fnPtr))(_shape); }, &_fn);
+        }
+    }
+
+    // prints all the models, each segment with direct calls
+    void print() const
+    {
+        for (auto const& segment : m_segments) {
+            segment->print();
+        }
+    }
+
+    std::size_t size() const
+    {
+        std::size_t size = 0;
+        for (auto const& segment : m_segments) {
+            size += segment->size();
+        }
+        return size;
     }
 
 private:
-    bool m_useCap;
-    bool m_showDecimal;
+
+    struct SegmentBase
+    {
+        virtual ~SegmentBase() = default;
+        virtual std::size_t size() const = 0;
+        virtual void print() const = 0;
+        virtual void for_each(void (*_fn)(ShapeConcept const&, void*), void* _context) const = 0;
+    };
+
+    template< typename ModelT >
+    struct Segment final : public SegmentBase
+    {
+        std::size_t size() const override { return m_models.size(); }
+
+        void print() const override
+        {
+            for (ModelT const& model : m_models) {
+                model.ModelT::print();  // qualified call: no virtual dispatch
+            }
+        }
+
+        void for_each(void (*_fn)(ShapeConcept const&, void*), void* _context) const override
+        {
+            for (ModelT const& model : m_models) {
+                _fn(model, _context);
+            }
+        }
+
+        std::vector<ModelT> m_models;
+    };
+
+    template< typename ModelT >
+    Segment<ModelT>& segment()
+    {
+        static_assert(std::is_base_of_v<ShapeConcept, ModelT>, "models must implement ShapeConcept");
+
+        SegmentBase*& segment = m_segmentsByType[typeid(ModelT)];
+        if (segment == nullptr) {
+            m_segments.push_back(std::make_unique< Segment<ModelT> >());
+            segment = m_segments.back().get();
+        }
+        return *static_cast<Segment<ModelT>*>(segment);
+    }
+
+    std::vector< std::unique_ptr<SegmentBase> > m_segments;
+    std::unordered_map< std::type_index, SegmentBase* > m_segmentsByType;
 };
 
 
+/*------------------------------------------------------------------------------------------------------------+
+|                                                  ORDEREDOUTPUT                                              |
++------------------------------------------------------------------------------------------------------------*/
+
+// Text output split in ordered parts: each thread formats into its own part,
+// then the parts are written in order, so the result does not depend on thread scheduling
+class OrderedOutput
+{
+public:
+    explicit OrderedOutput(std::size_t _nbParts)
+        : m_parts(_nbParts)
+    {}
+
+    std::size_t nbParts() const { return m_parts.size(); }
+    std::string& part(std::size_t _index) { return m_parts[_index]; }
+
+    void writeTo(std::ostream& _out) const
+    {
+        for (auto const& part : m_parts) {
+            _out.write(part.data(), std::streamsize(part.size()));
+        }
+    }
+
+    // empties the parts, keeping their memory for the next use
+    void clear()
+    {
+        for (auto& part : m_parts) {
+            part.clear();
+        }
+    }
+
+private:
+    std::vector<std::string> m_parts;
+};
+
+// formats _shapes with one thread per part of _output, each thread taking a contiguous range of shapes
+template< typename ShapeT >
+void formatInParallel(std::span<const ShapeT> _shapes, ShapeFormatter const& _formatter, OrderedOutput& _output)
+{
+    const std::size_t nbParts = _output.nbParts();
+    std::vector<std::jthread> threads;
+    for (std::size_t p = 0; p < nbParts; ++p)
+    {
+        threads.emplace_back([&, p]() {
+            const std::size_t begin = _shapes.size() * p / nbParts;
+            const std::size_t end = _shapes.size() * (p + 1) / nbParts;
+            for (std::size_t i = begin; i < end; ++i) {
+                _formatter.format(_shapes[i], _output.part(p));
+            }
+        });
+    }
+}
+
+
 /*------------------------------------------------------------------------------------------------------------+
 |                                                      MAIN                                                   |
 +------------------------------------------------------------------------------------------------------------*/
@@ -204,5 +492,46 @@ int main()
         shape->print();
     }
 
+    std::cout << std::endl;
+
+    // Segmented collection: one contiguous array per model type
+    SegmentedShapes segmentedShapes;
+    segmentedShapes.emplace< ShapeModelv1<Circle> >( Circle(Point(6.0, 6.0), 16.0) );
+    segmentedShapes.emplace< ShapeModelv2<Square, PrintStrategy> >( Square(Point(7.0, 7.0), 17.0), PrintStrategy(false, false) );
+    segmentedShapes.emplace< ShapeModelv1<Circle> >( Circle(Point(8.0, 8.0), 18.0) );
+
+    // typed iteration, over the Circles only
+    segmentedShapes.for_each< ShapeModelv1<Circle> >( [](ShapeModelv1<Circle> const& _circle) { _circle.print(); } );
+
+    std::cout << std::endl;
+
+    // iteration over all the segments
+    segmentedShapes.for_each( [](ShapeConcept const& _shape) { _shape.print(); } );
+
+    std::cout << std::endl;
+
+    // Borrowing models: shapes owned by "another subsystem" are not copied
+    std::vector<Circle> ownedCircles{ Circle(Point(9.0, 9.0), 19.0), Circle(Point(10.0, 10.0), 20.0) };
+    Square ownedSquare(Point(11.0, 11.0), 21.0);
+
+    shapes.clear();
+    shapes.push_back( std::make_unique< ShapeSpanModel<Circle> >( ownedCircles ) );  // one model for the whole array
+    shapes.push_back( std::make_unique< ShapeRefModel<Square, PrintStrategy> >( ownedSquare, PrintStrategy(true, true) ) );
+
+    for (auto const& shape : shapes) {
+        shape->print();
+    }
+
+    std::cout << std::endl;
+
+    // Formatting with several threads, merged in order
+    std::vector<Circle> manyCircles;
+    for (int i = 0; i < 8; ++i) {
+        manyCircles.emplace_back(Point(double(i), double(i)), 1.0 + i / 3.0);
+    }
+    OrderedOutput output(4);
+    formatInParallel<Circle>(manyCircles, ShapeFormatter(true, true), output);
+    output.writeTo(std::cout);
+
     return EXIT_SUCCESS;
 }
@@ -15,6 +15,11 @@
 #include <variant>
 #include <vector>
 #include <numbers>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <chrono>
+#include <utility>
 
 
 struct Point
@@ -88,6 +93,51 @@ private:
 };
 
 
+/*------------------------------------------------------------------------------------------------------------+
+|                                                   SHAPEBUFFER                                               |
++-------------------------------------------------------------------------------------------------------------*/
+
+// Aligned storage provided by the creator's caller, in which a Shape is constructed in place.
+// Owns the Shape it contains (destroyed with the buffer or by the next emplace()).
+class ShapeBuffer
+{
+public:
+    static constexpr std::size_t capacity = 64;
+
+    ShapeBuffer() = default;
+    ShapeBuffer(ShapeBuffer const&) = delete;
+    ShapeBuffer& operator=(ShapeBuffer const&) = delete;
+
+    ~ShapeBuffer() { reset(); }
+
+    template< typename ShapeT, typename... Args >
+    ShapeT& emplace(Args&&... _args)
+    {
+        static_assert(sizeof(ShapeT) <= capacity, "Shape too large for ShapeBuffer");
+        static_assert(alignof(ShapeT) <= alignof(std::max_align_t), "Shape over-aligned for ShapeBuffer");
+
+        reset();
+        ShapeT* shape = ::new (static_cast<void*>(m_storage)) ShapeT(std::forward<Args>(_args)...);
+        m_shape = shape;
+        return *shape;
+    }
+
+    Shape* get() const { return m_shape; }
+
+    void reset()
+    {
+        if (m_shape) {
+            std::destroy_at(m_shape);
+            m_shape = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) std::byte m_storage[capacity];
+    Shape* m_shape = nullptr;
+};
+
+
 /*------------------------------------------------------------------------------------------------------------+
 |                                                   SHAPECREATOR                                              |
 +-------------------------------------------------------------------------------------------------------------*/
@@ -102,6 +152,9 @@ public:
     // Factory method
     // To be implemented by derived classes (may then return different types of Shapes)
     virtual std::shared_ptr<Shape> FactoryMethod() const = 0;
+
+    // In-place factory method: constructs the Shape into _buffer, without allocation
+    virtual Shape& FactoryMethodInPlace(ShapeBuffer& _buffer) const = 0;
     
     double shapeArea() const 
     {
@@ -110,6 +163,13 @@ public:
         // Now, use the Shape.
         return shape->area();
     }
+
+    // Same as shapeArea(), with the Shape created on the stack
+    double shapeAreaInPlace() const
+    {
+        ShapeBuffer buffer;
+        return this->FactoryMethodInPlace(buffer).area();
+    }
 };
 
 
@@ -126,6 +186,11 @@ public:
         // Creates a Circle of radius 1
         return std::make_shared<Circle>(1.0);
     }
+
+    Shape& FactoryMethodInPlace(ShapeBuffer& _buffer) const override
+    {
+        return _buffer.emplace<Circle>(1.0);
+    }
 };
 
 
@@ -141,6 +206,11 @@ public:
         // Creates a Square of side 1
         return std::make_shared<Square>(1.0);
     }
+
+    Shape& FactoryMethodInPlace(ShapeBuffer& _buffer) const override
+    {
+        return _buffer.emplace<Square>(1.0);
+    }
 };
 
 
@@ -156,5 +226,30 @@ int main()
     SquareCreator creator2;
     std::cout << "Square area = " << creator2.shapeArea() << std::endl;
 
+    std::cout << "Circle area (in place) = " << creator1.shapeAreaInPlace() << std::endl;
+    std::cout << "Square area (in place) = " << creator2.shapeAreaInPlace() << std::endl;
+
+    // Benchmark: shared_ptr factory method vs in-place factory method
+    constexpr int nbCalls = 10'000'000;
+    ShapeCreator const* creators[2] = { &creator1, &creator2 };
+
+    double sum = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < nbCalls; ++i) {
+        sum += creators[i & 1]->shapeArea();
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "shapeArea():        " << std::chrono::duration<double, std::nano>(end - start).count() / nbCalls
+              << " ns/call (sum = " << sum << ")" << std::endl;
+
+    sum = 0.0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < nbCalls; ++i) {
+        sum += creators[i & 1]->shapeAreaInPlace();
+    }
+    end = std::chrono::steady_clock::now();
+    std::cout << "shapeAreaInPlace(): " << std::chrono::duration<double, std::nano>(end - start).count() / nbCalls
+              << " ns/call (sum = " << sum << ")" << std::endl;
+
     return EXIT_SUCCESS;
 }
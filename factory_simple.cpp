@@ -11,6 +11,22 @@
  //     https://refactoring.guru/design-patterns/factory-comparison
 
 #include <iostream>
+#include <memory>
+#include <vector>
+#include <span>
+#include <variant>
+#include <stdexcept>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <mutex>
+#include <map>
+#include <utility>
+#include <algorithm>
 # define _USE_MATH_DEFINES
 #include <math.h>
 
@@ -96,6 +112,20 @@ private:
 |                                                   SHAPEFACTORY                                              |
 +-------------------------------------------------------------------------------------------------------------*/
 
+// Shape stored by value, for contiguous storage with unique ownership
+using ShapeValue = std::variant<Circle, Square>;
+
+inline Shape& asShape(ShapeValue& _value)
+{
+    return std::visit([](auto& _shape) -> Shape& { return _shape; }, _value);
+}
+
+inline Shape const& asShape(ShapeValue const& _value)
+{
+    return std::visit([](auto const& _shape) -> Shape const& { return _shape; }, _value);
+}
+
+
 class ShapeFactory
 {
 
@@ -118,6 +148,233 @@ public:
         }
     }
 
+    // Creates a shape with its real dimension (radius or side)
+    static std::shared_ptr<Shape> createShape(const TypeShape _typeShape, const double _size)
+    {
+        switch (_typeShape)
+        {
+            case TypeShape::circle:
+                return std::make_shared<Circle>(_size);
+            case TypeShape::square:
+                return std::make_shared<Square>(_size);
+            default:
+                return nullptr;
+        }
+    }
+
+    // Interning: returns a shared immutable instance, created only once per type of shape
+    static std::shared_ptr<const Shape> internShape(const TypeShape _typeShape)
+    {
+        static const std::shared_ptr<const Shape> unitCircle = std::make_shared<const Circle>(1.0);
+        static const std::shared_ptr<const Shape> unitSquare = std::make_shared<const Square>(1.0);
+
+        switch (_typeShape)
+        {
+            case TypeShape::circle:
+                return unitCircle;
+            case TypeShape::square:
+                return unitSquare;
+            default:
+                return nullptr;
+        }
+    }
+
+    // Interning by parameter set: one shared immutable instance per (type, size) already seen.
+    // Hits are served by a per-thread cache without locking; only the first request of a thread
+    // for a given key goes through the shared cache, so all threads get the same instance.
+    static std::shared_ptr<const Shape> internShape(const TypeShape _typeShape, const double _size)
+    {
+        if (std::isnan(_size)) {
+            throw std::invalid_argument("ShapeFactory::internShape(): NaN size");   // would break the key ordering
+        }
+
+        using Key = std::pair<TypeShape, double>;
+        const Key key{ _typeShape, _size };
+
+        thread_local std::map<Key, std::shared_ptr<const Shape>> localCache;
+        if (auto it = localCache.find(key); it != localCache.end()) {
+            return it->second;
+        }
+
+        static std::mutex sharedMutex;
+        static std::map<Key, std::shared_ptr<const Shape>> sharedCache;
+
+        std::shared_ptr<const Shape> shape;
+        {
+            std::lock_guard lock(sharedMutex);
+            auto& cached = sharedCache[key];
+            if (!cached) {
+                cached = createShape(_typeShape, _size);
+            }
+            shape = cached;
+        }
+        localCache.emplace(key, shape);
+        return shape;
+    }
+
+    // Batch creation: appends one shape per type to _out, without any allocation per shape
+    static void createShapes(std::span<const TypeShape> _typeShapes, std::vector<ShapeValue>& _out)
+    {
+        _out.reserve(_out.size() + _typeShapes.size());
+        for (const TypeShape typeShape : _typeShapes) {
+            appendShape(typeShape, 1.0, _out);
+        }
+    }
+
+    // Appends a shape of dimension _size to _out
+    static void appendShape(const TypeShape _typeShape, const double _size, std::vector<ShapeValue>& _out)
+    {
+        switch (_typeShape)
+        {
+            case TypeShape::circle:
+                _out.emplace_back(std::in_place_type<Circle>, _size);
+                break;
+            case TypeShape::square:
+                _out.emplace_back(std::in_place_type<Square>, _size);
+                break;
+            default:
+                throw std::invalid_argument("ShapeFactory: unknown TypeShape");
+        }
+    }
+
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                   SHAPEINGEST                                               |
++-------------------------------------------------------------------------------------------------------------*/
+
+// Streaming front end of ShapeFactory: reads text lines such as "circle 2.3" or "square 1.2"
+// in large chunks, and creates the shapes with their dimension
+class ShapeIngest
+{
+public:
+    explicit ShapeIngest(std::size_t _chunkSize = std::size_t(1) << 20)
+        : m_buffer(_chunkSize)
+    {}
+
+    // reads all of _file, appends the shapes to _out, and returns the number of bytes read
+    std::size_t ingest(std::FILE* _file, std::vector<ShapeValue>& _out)
+    {
+        std::size_t total = 0;
+        std::size_t carried = 0;   // incomplete last line of the previous chunk, moved to the front of the buffer
+        for (;;)
+        {
+            if (carried == m_buffer.size()) {
+                m_buffer.resize(m_buffer.size() * 2);   // line longer than a chunk
+            }
+
+            const std::size_t nbRead = std::fread(m_buffer.data() + carried, 1, m_buffer.size() - carried, _file);
+            total += nbRead;
+
+            const char* first = m_buffer.data();
+            const char* last = first + carried + nbRead;
+            if (nbRead == 0) {
+                parse(std::string_view(first, carried), _out);   // last line, without line feed
+                break;
+            }
+
+            const char* endOfLines = last;
+            while (endOfLines != first && endOfLines[-1] != '\n') {
+                --endOfLines;
+            }
+
+            parse(std::string_view(first, std::size_t(endOfLines - first)), _out);
+            carried = std::size_t(last - endOfLines);
+            std::memmove(m_buffer.data(), endOfLines, carried);
+        }
+
+        if (std::ferror(_file)) {
+            throw std::runtime_error("ShapeIngest::ingest(): read error");
+        }
+        return total;
+    }
+
+    // parses the lines of _text (the last one may have no line feed)
+    static void parse(std::string_view _text, std::vector<ShapeValue>& _out)
+    {
+        if (_text.empty()) {
+            return;
+        }
+        const char* first = _text.data();
+        const char* last = first + _text.size();
+
+        // at most one shape per line: grow _out geometrically, not once per chunk
+        const std::size_t nbLines = std::size_t(std::count(first, last, '\n')) + (_text.back() != '\n' ? 1 : 0);
+        const std::size_t maxSize = _out.size() + nbLines;
+        if (maxSize > _out.capacity()) {
+            _out.reserve(std::max(maxSize, 2 * _out.capacity()));
+        }
+
+        while (first != last) {
+            first = parseLine(first, last, _out);
+        }
+    }
+
+private:
+
+    static const char* skipBlanks(const char* _first, const char* _last)
+    {
+        while (_first != _last && (*_first == ' ' || *_first == '\t' || *_first == '\r')) {
+            ++_first;
+        }
+        return _first;
+    }
+
+    // perfect hash of the type names: bit 4 of the first letter is 0 for 'c' (0x63), 1 for 's' (0x73)
+    static TypeShape parseType(std::string_view _name)
+    {
+        static constexpr std::string_view names[2] = { "circle", "square" };
+        static constexpr TypeShape types[2] = { TypeShape::circle, TypeShape::square };
+
+        if (!_name.empty())
+        {
+            const unsigned slot = (static_cast<unsigned char>(_name[0]) >> 4) & 1u;
+            if (_name == names[slot]) {
+                return types[slot];
+            }
+        }
+        throw std::invalid_argument("ShapeIngest: unknown shape type '" + std::string(_name) + "'");
+    }
+
+    // parses one line starting at _first, and returns the start of the next line
+    static const char* parseLine(const char* _first, const char* _last, std::vector<ShapeValue>& _out)
+    {
+        _first = skipBlanks(_first, _last);
+        if (_first == _last) { return _last; }
+        if (*_first == '\n') { return _first + 1; }   // empty line
+
+        const char* nameEnd = _first;
+        while (nameEnd != _last && *nameEnd != ' ' && *nameEnd != '\t' && *nameEnd != '\r' && *nameEnd != '\n') {
+            ++nameEnd;
+        }
+        const std::string_view name(_first, std::size_t(nameEnd - _first));
+        const TypeShape typeShape = parseType(name);
+
+        const char* valueBegin = skipBlanks(nameEnd, _last);
+        if (valueBegin == _last || *valueBegin == '\n') {
+            throw std::invalid_argument("ShapeIngest: missing dimension after '" + std::string(name) + "'");
+        }
+
+        double size = 0.0;
+        auto [valueEnd, error] = std::from_chars(valueBegin, _last, size);
+        if (error != std::errc()) {
+            throw std::invalid_argument("ShapeIngest: invalid dimension");
+        }
+        if (!std::isfinite(size) || size <= 0.0) {
+            throw std::invalid_argument("ShapeIngest: dimension must be finite and positive");
+        }
+
+        const char* lineEnd = skipBlanks(valueEnd, _last);
+        if (lineEnd != _last && *lineEnd != '\n') {
+            throw std::invalid_argument("ShapeIngest: unexpected characters after dimension");
+        }
+
+        ShapeFactory::appendShape(typeShape, size, _out);
+        return lineEnd == _last ? _last : lineEnd + 1;
+    }
+
+    std::vector<char> m_buffer;
 };
 
 
@@ -133,5 +390,66 @@ int main()
 
     std::cout << "Square area = " << factory.createShape(TypeShape::square)->area() << std::endl;
 
+    // Interned shapes: same instance for the same type
+    auto circleA = ShapeFactory::internShape(TypeShape::circle);
+    auto circleB = ShapeFactory::internShape(TypeShape::circle);
+    std::cout << "Interned circles are " << (circleA == circleB ? "shared" : "distinct") << std::endl;
+
+    auto squareA = ShapeFactory::internShape(TypeShape::square, 2.5);
+    auto squareB = ShapeFactory::internShape(TypeShape::square, 2.5);
+    std::cout << "Interned squares of side 2.5 are " << (squareA == squareB ? "shared" : "distinct") << std::endl;
+
+    // Batch creation into contiguous storage
+    std::vector<TypeShape> types;
+    for (int i = 0; i < 1'000'000; ++i) {
+        types.push_back(i % 2 ? TypeShape::square : TypeShape::circle);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<Shape>> sharedShapes;
+    sharedShapes.reserve(types.size());
+    for (const TypeShape type : types) {
+        sharedShapes.push_back(ShapeFactory::createShape(type));
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "createShape() x " << types.size() << ": "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    std::vector<ShapeValue> shapes;
+    ShapeFactory::createShapes(types, shapes);
+    end = std::chrono::steady_clock::now();
+    std::cout << "createShapes(" << shapes.size() << "): "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+
+    double totalArea = 0.0;
+    for (auto const& shape : shapes) {
+        totalArea += asShape(shape).area();
+    }
+    std::cout << "Total area = " << totalArea << std::endl;
+
+    // Streaming ingest of a text feed
+    std::FILE* feed = std::tmpfile();
+    if (!feed) {
+        std::cerr << "Cannot create temporary file" << std::endl;
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < 2'000'000; ++i) {
+        std::fprintf(feed, i % 2 ? "square %.3f\n" : "circle %.3f\n", 0.5 + (i % 1000) * 0.01);
+    }
+    std::rewind(feed);
+
+    ShapeIngest ingest;
+    std::vector<ShapeValue> ingested;
+    start = std::chrono::steady_clock::now();
+    const std::size_t nbBytes = ingest.ingest(feed, ingested);
+    end = std::chrono::steady_clock::now();
+    std::fclose(feed);
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << "Ingested " << ingested.size() << " shapes (" << nbBytes << " bytes) at "
+              << nbBytes / seconds / 1e9 << " GB/s" << std::endl;
+    std::cout << "First shape area = " << asShape(ingested.front()).area() << std::endl;
+
     return EXIT_SUCCESS;
 }
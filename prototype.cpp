@@ -9,6 +9,18 @@
 
 #include <iostream>
 #include <vector>
+#include <memory>
+#include <span>
+#include <new>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <bit>
+#include <thread>
+#include <stdexcept>
+#include <cassert>
+#include <cstddef>
 # define _USE_MATH_DEFINES
 #include <math.h>
 
@@ -21,6 +33,99 @@ struct Point
 
 
 
+/*------------------------------------------------------------------------------------------------------------+
+|                                                    SHAPEPOOL                                                |
++-------------------------------------------------------------------------------------------------------------*/
+
+class Shape;
+
+// View on a block of clones stored contiguously in a ShapePool
+class ShapeBlock
+{
+public:
+    using AtFn = Shape* (*)(void*, std::size_t);
+
+    ShapeBlock(void* _data, std::size_t _count, AtFn _at)
+        : m_data(_data), m_count(_count), m_at(_at)
+    {}
+
+    std::size_t size() const { return m_count; }
+    Shape& operator[](std::size_t _index) const { return *m_at(m_data, _index); }
+
+private:
+    void*       m_data;
+    std::size_t m_count;
+    AtFn        m_at;    // gets the Shape at an index, knowing the concrete type of the block
+};
+
+
+// Owns the clones created by Shape::cloneMany(): one allocation per block of clones
+class ShapePool
+{
+public:
+    ShapePool() = default;
+    ShapePool(ShapePool const&) = delete;
+    ShapePool& operator=(ShapePool const&) = delete;
+
+    ~ShapePool()
+    {
+        for (auto it = m_blocks.rbegin(); it != m_blocks.rend(); ++it) {
+            it->destroy(it->data, it->count);
+        }
+    }
+
+    // copy-constructs _count instances of _prototype in a new contiguous block
+    template< typename ShapeT >
+    ShapeBlock fill(ShapeT const& _prototype, std::size_t _count)
+    {
+        // room for the block reserved up front, so that registering it cannot throw
+        // (grown geometrically: reserve() allocates exactly the requested size)
+        if (m_blocks.size() == m_blocks.capacity()) {
+            m_blocks.reserve(2 * m_blocks.size() + 1);
+        }
+
+        void* data = ::operator new(_count * sizeof(ShapeT), std::align_val_t(alignof(ShapeT)));
+        try {
+            std::uninitialized_fill_n(static_cast<ShapeT*>(data), _count, _prototype);
+        }
+        catch (...) {
+            ::operator delete(data, std::align_val_t(alignof(ShapeT)));
+            throw;
+        }
+
+        m_blocks.push_back({ data, _count, &destroyBlock<ShapeT> });
+        return ShapeBlock(data, _count, &shapeAt<ShapeT>);
+    }
+
+    std::size_t nbBlocks() const { return m_blocks.size(); }
+
+private:
+
+    struct Block
+    {
+        void*       data;
+        std::size_t count;
+        void (*destroy)(void*, std::size_t);  // type-erased destruction of the block
+    };
+
+    template< typename ShapeT >
+    static void destroyBlock(void* _data, std::size_t _count)
+    {
+        std::destroy_n(static_cast<ShapeT*>(_data), _count);
+        ::operator delete(_data, std::align_val_t(alignof(ShapeT)));
+    }
+
+    template< typename ShapeT >
+    static Shape* shapeAt(void* _data, std::size_t _index)
+    {
+        return static_cast<ShapeT*>(_data) + _index;
+    }
+
+    std::vector<Block> m_blocks;
+};
+
+
+
 /*------------------------------------------------------------------------------------------------------------+
 |                                                      SHAPE                                                  |
 +-------------------------------------------------------------------------------------------------------------*/
@@ -39,10 +144,26 @@ public:
 
     virtual std::unique_ptr<Shape> clone() const = 0;
 
+    // creates _count clones at once, stored contiguously in _pool
+    virtual ShapeBlock cloneMany(std::size_t _count, ShapePool& _pool) const = 0;
+
     void setCenter(Point _center) { m_center = _center; }
 
+    // opt-in diagnostics of clone()/cloneMany(): off by default, so that spawning is not slowed down by I/O
+    static void setCloneTrace(bool _enabled) { s_cloneTrace.store(_enabled, std::memory_order_relaxed); }
+
 protected:
+    static void traceClone(char const* _shapeName, std::size_t _count)
+    {
+        if (!s_cloneTrace.load(std::memory_order_relaxed)) { return; }
+        if (_count == 1) { std::cout << _shapeName << "::clone()" << std::endl; }
+        else { std::cout << _shapeName << "::cloneMany(" << _count << ")" << std::endl; }
+    }
+
     Point m_center;
+
+private:
+    static inline std::atomic<bool> s_cloneTrace{ false };   // atomic: clones may be made by other threads
 };
 
 
@@ -63,12 +184,18 @@ public:
                   << "), radius = " << m_radius << std::endl;
     }
 
-    std::unique_ptr<Shape> clone() const override 
+    std::unique_ptr<Shape> clone() const override
     {
-        std::cout << "Circle::clone()" << std::endl;
+        traceClone("Circle", 1);
         return std::make_unique<Circle>(*this);
     }
 
+    ShapeBlock cloneMany(std::size_t _count, ShapePool& _pool) const override
+    {
+        traceClone("Circle", _count);
+        return _pool.fill(*this, _count);
+    }
+
 private:
     double m_radius;
 };
@@ -93,15 +220,256 @@ public:
 
     std::unique_ptr<Shape> clone() const override
     {
-        std::cout << "Square::clone()" << std::endl;
+        traceClone("Square", 1);
         return std::make_unique<Square>(*this);
     }
 
+    ShapeBlock cloneMany(std::size_t _count, ShapePool& _pool) const override
+    {
+        traceClone("Square", _count);
+        return _pool.fill(*this, _count);
+    }
+
 private:
     double m_side;
 };
 
 
+/*------------------------------------------------------------------------------------------------------------+
+|                                                    CLONEINTO                                                |
++-------------------------------------------------------------------------------------------------------------*/
+
+// copy-constructs as many clones of _prototype as fit in the raw _storage provided by the caller
+// (which must be aligned for ShapeT), and returns them; the caller destroys them with std::destroy()
+template< typename ShapeT >
+std::span<ShapeT> cloneInto(ShapeT const& _prototype, std::span<std::byte> _storage)
+{
+    assert(reinterpret_cast<std::uintptr_t>(_storage.data()) % alignof(ShapeT) == 0);
+
+    const std::size_t count = _storage.size() / sizeof(ShapeT);
+    ShapeT* first = reinterpret_cast<ShapeT*>(_storage.data());
+    std::uninitialized_fill_n(first, count, _prototype);
+    return std::span<ShapeT>(std::launder(first), count);
+}
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                   BOUNDEDQUEUE                                              |
++-------------------------------------------------------------------------------------------------------------*/
+
+// Bounded multi-producer multi-consumer lock-free queue (Dmitry Vyukov's algorithm):
+// each cell has a sequence number telling whether it is ready to be written or read
+template< typename T >
+class BoundedQueue
+{
+public:
+    // _capacity is rounded up to a power of 2
+    explicit BoundedQueue(std::size_t _capacity)
+        : m_cells(std::bit_ceil(std::max<std::size_t>(_capacity, 2)))
+        , m_mask(m_cells.size() - 1)
+    {
+        for (std::size_t i = 0; i < m_cells.size(); ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    std::size_t capacity() const { return m_cells.size(); }
+
+    // _value is left untouched if the queue is full
+    bool tryPush(T&& _value)
+    {
+        std::size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            const std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(_value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;   // full
+            }
+            else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& _value)
+    {
+        std::size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            const std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    _value = std::move(cell.value);
+                    cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;   // empty
+            }
+            else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::vector<Cell> m_cells;
+    const std::size_t m_mask;
+
+    // producers and consumers on separate cache lines
+    alignas(64) std::atomic<std::size_t> m_enqueuePos{ 0 };
+    alignas(64) std::atomic<std::size_t> m_dequeuePos{ 0 };
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                PROTOTYPEREGISTRY                                            |
++-------------------------------------------------------------------------------------------------------------*/
+
+using PrototypeId = std::uint32_t;
+
+// Registry of prototypes, identified by a compact ID.
+// Each prototype can have a queue of pre-warmed clones, refilled by a background thread,
+// so that acquire() only pops a ready-made clone instead of constructing one.
+// All prototypes must be added before startRefiller() is called.
+class PrototypeRegistry
+{
+public:
+    PrototypeRegistry() = default;
+    PrototypeRegistry(PrototypeRegistry const&) = delete;
+    PrototypeRegistry& operator=(PrototypeRegistry const&) = delete;
+
+    ~PrototypeRegistry()
+    {
+        stopRefiller();
+    }
+
+    // registers _prototype, with _nbWarm clones created up front (0 = no pre-warmed clones)
+    PrototypeId add(std::unique_ptr<Shape> _prototype, std::size_t _nbWarm = 0)
+    {
+        if (m_refiller.joinable()) {
+            throw std::logic_error("PrototypeRegistry::add() called after startRefiller()");
+        }
+
+        auto entry = std::make_unique<Entry>(std::move(_prototype), _nbWarm);
+        refill(*entry);
+        m_entries.push_back(std::move(entry));
+        return static_cast<PrototypeId>(m_entries.size() - 1);
+    }
+
+    // returns a clone of prototype _id: a pre-warmed one if available, a new one otherwise
+    std::unique_ptr<Shape> acquire(PrototypeId _id)
+    {
+        Entry& entry = *m_entries.at(_id);
+        if (entry.warm) {
+            std::unique_ptr<Shape> shape;
+            if (entry.warm->tryPop(shape)) {
+                requestRefill();
+                return shape;
+            }
+            entry.misses.fetch_add(1, std::memory_order_relaxed);
+            requestRefill();
+        }
+        return entry.prototype->clone();
+    }
+
+    Shape const& prototype(PrototypeId _id) const { return *m_entries.at(_id)->prototype; }
+
+    // number of acquire() calls that found an empty queue
+    std::size_t misses(PrototypeId _id) const { return m_entries.at(_id)->misses.load(std::memory_order_relaxed); }
+
+    void startRefiller()
+    {
+        if (m_refiller.joinable()) { return; }
+        m_refiller = std::jthread([this](std::stop_token _stop) { refillLoop(_stop); });
+    }
+
+    void stopRefiller()
+    {
+        if (!m_refiller.joinable()) { return; }
+        m_refiller.request_stop();
+        m_refillRequested.store(1, std::memory_order_release);   // wakes up the refiller so it sees the stop
+        m_refillRequested.notify_one();
+        m_refiller.join();
+    }
+
+private:
+
+    struct Entry
+    {
+        Entry(std::unique_ptr<Shape> _prototype, std::size_t _nbWarm)
+            : prototype(std::move(_prototype))
+        {
+            if (_nbWarm > 0) {
+                warm = std::make_unique<BoundedQueue<std::unique_ptr<Shape>>>(_nbWarm);
+            }
+        }
+
+        std::unique_ptr<Shape> prototype;
+        std::unique_ptr<BoundedQueue<std::unique_ptr<Shape>>> warm;   // null if not pre-warmed
+        std::atomic<std::size_t> misses{ 0 };
+        std::unique_ptr<Shape> spare;   // clone refused by a full queue, kept for the next refill
+    };
+
+    // tops up the queue of _entry until it is full (only called by one thread at a time)
+    static void refill(Entry& _entry)
+    {
+        if (!_entry.warm) { return; }
+        for (;;) {
+            if (!_entry.spare) {
+                _entry.spare = _entry.prototype->clone();
+            }
+            if (!_entry.warm->tryPush(std::move(_entry.spare))) { return; }
+        }
+    }
+
+    // wakes up the refiller, once per refill round.
+    // 32-bit atomic: with libstdc++ on Linux, notify_one() is a futex wake, without any lock
+    void requestRefill()
+    {
+        if (m_refillRequested.exchange(1, std::memory_order_acq_rel) == 0) {
+            m_refillRequested.notify_one();
+        }
+    }
+
+    void refillLoop(std::stop_token _stop)
+    {
+        while (!_stop.stop_requested())
+        {
+            // reset before refilling: a request made during the refill makes wait() return at once
+            m_refillRequested.store(0, std::memory_order_release);
+            for (auto& entry : m_entries) {
+                refill(*entry);
+            }
+            m_refillRequested.wait(0, std::memory_order_acquire);
+        }
+    }
+
+    std::vector<std::unique_ptr<Entry>> m_entries;
+
+    std::atomic<std::uint32_t> m_refillRequested{ 0 };
+    std::jthread               m_refiller;    // last member: stopped before the others are destroyed
+};
+
+
 /*------------------------------------------------------------------------------------------------------------+
 |                                                      MAIN                                                   |
 +-------------------------------------------------------------------------------------------------------------*/
@@ -115,6 +483,8 @@ int main()
     circle1->print();
     square1->print();
 
+    Shape::setCloneTrace(true);
+
     // clone them
     std::unique_ptr<Shape> circle2(circle1->clone()); // circle2 = circle1
     circle1->setCenter({ 1,2 });                      // change circle1 position
@@ -130,6 +500,79 @@ int main()
     square2->print();
     square3->print();
 
+    std::cout << std::endl;
+
+    // bulk cloning: one block per cloneMany() call
+    ShapePool pool;
+    ShapeBlock circles = circle1->cloneMany(3, pool);
+    ShapeBlock squares = square1->cloneMany(2, pool);
+    for (std::size_t i = 0; i < circles.size(); ++i) {
+        circles[i].print();
+    }
+    for (std::size_t i = 0; i < squares.size(); ++i) {
+        squares[i].print();
+    }
+
+    // cloning into caller-provided raw storage
+    alignas(Circle) std::byte storage[2 * sizeof(Circle)];
+    std::span<Circle> circleArray = cloneInto(static_cast<Circle const&>(*circle1), std::span<std::byte>(storage));
+    circleArray[1].print();
+    std::destroy(circleArray.begin(), circleArray.end());
+
+    Shape::setCloneTrace(false);   // no diagnostics from here: benchmarks and background threads
+    std::cout << std::endl;
+
+    // spawning many copies: clone() vs cloneMany()
+    constexpr std::size_t nbCopies = 100'000;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<Shape>> clones;
+    clones.reserve(nbCopies);
+    for (std::size_t i = 0; i < nbCopies; ++i) {
+        clones.push_back(circle1->clone());
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "clone() x " << nbCopies << ": "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    ShapePool spawnPool;
+    ShapeBlock spawned = circle1->cloneMany(nbCopies, spawnPool);
+    end = std::chrono::steady_clock::now();
+    std::cout << "cloneMany(" << spawned.size() << "): "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms, "
+              << spawnPool.nbBlocks() << " block(s)" << std::endl;
+
+    std::cout << std::endl;
+
+    // registry of prototypes with pre-warmed clones
+    PrototypeRegistry registry;
+    const PrototypeId smallCircle = registry.add(std::make_unique<Circle>(0.5), 64);
+    const PrototypeId bigSquare = registry.add(std::make_unique<Square>(10.0));  // cloned on demand
+    registry.startRefiller();
+
+    registry.acquire(smallCircle)->print();
+    registry.acquire(bigSquare)->print();
+
+    // requests arrive in bursts smaller than the queue: the refiller tops it up in between
+    constexpr std::size_t nbBursts = 100;
+    constexpr std::size_t burstSize = 32;
+    std::vector<std::unique_ptr<Shape>> acquired;
+    acquired.reserve(burstSize);
+    std::chrono::steady_clock::duration acquireTime{};
+    for (std::size_t b = 0; b < nbBursts; ++b)
+    {
+        acquired.clear();
+        start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < burstSize; ++i) {
+            acquired.push_back(registry.acquire(smallCircle));
+        }
+        acquireTime += std::chrono::steady_clock::now() - start;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::cout << "acquire() x " << nbBursts * burstSize << ": "
+              << std::chrono::duration<double, std::milli>(acquireTime).count() << " ms, "
+              << registry.misses(smallCircle) << " miss(es)" << std::endl;
 
     return EXIT_SUCCESS;
 }
@@ -10,6 +10,16 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <type_traits>
+#include <atomic>
+#include <utility>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <limits>
 # define _USE_MATH_DEFINES
 #include <math.h>
 
@@ -36,6 +46,8 @@ public:
     Point  center() const { return m_center; }
     double radius() const { return m_radius; }
 
+    void setCenter(Point _center) { m_center = _center; }
+
 private:
     Point  m_center;
     double m_radius;
@@ -57,52 +69,115 @@ public:
     Point  center() const { return m_center; }
     double side() const { return m_side; }
 
+    void setCenter(Point _center) { m_center = _center; }
+
 private:
     Point  m_center;
     double m_side;
 };
 
 
+/*------------------------------------------------------------------------------------------------------------+
+|                                                  SHAPEFORMATTER                                             |
++------------------------------------------------------------------------------------------------------------*/
+
+// Formatting engine of PrintStrategy1: appends the text of a shape to a string with std::to_chars,
+// without any stream or global state, so it can be used from several threads with deterministic output
+class ShapeFormatter
+{
+public:
+    explicit ShapeFormatter(bool _useCap, bool _showDecimals)
+        : m_layout(&layouts[_useCap][_showDecimals])
+    {}
+
+    void format(Circle const& _circle, std::string& _out) const
+    {
+        _out += m_layout->circlePrefix;
+        appendPoint(_circle.center(), _out);
+        _out += "), radius = ";
+        appendNumber(_circle.radius(), _out);
+        _out += '\n';
+    }
+
+    void format(Square const& _square, std::string& _out) const
+    {
+        _out += m_layout->squarePrefix;
+        appendPoint(_square.center(), _out);
+        _out += "), side = ";
+        appendNumber(_square.side(), _out);
+        _out += '\n';
+    }
+
+private:
+
+    // precomputed layout of each (useCap, showDecimals) configuration
+    struct Layout
+    {
+        std::string_view circlePrefix;
+        std::string_view squarePrefix;
+        int precision;
+    };
+
+    static constexpr Layout layouts[2][2] = {
+        { { "circle: center = (", "square: center = (", 0 }, { "circle: center = (", "square: center = (", 2 } },
+        { { "CIRCLE: center = (", "SQUARE: center = (", 0 }, { "CIRCLE: center = (", "SQUARE: center = (", 2 } }
+    };
+
+    void appendPoint(Point _point, std::string& _out) const
+    {
+        appendNumber(_point.x, _out);
+        _out += ", ";
+        appendNumber(_point.y, _out);
+    }
+
+    // same output as std::fixed with std::setprecision(precision)
+    void appendNumber(double _value, std::string& _out) const
+    {
+        char buffer[std::numeric_limits<double>::max_exponent10 + 32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), _value, std::chars_format::fixed, m_layout->precision);
+        _out.append(buffer, result.ptr);
+    }
+
+    Layout const* m_layout;
+};
+
+
 /*------------------------------------------------------------------------------------------------------------+
 |                                                  PRINTSTRATEGIES                                            |
 +------------------------------------------------------------------------------------------------------------*/
 
 // Collection of print functions, with different options
+// (does not change the state of std::cout: safe to use from several threads)
 class PrintStrategy1
 {
 public:
     explicit PrintStrategy1(bool _useCap, bool _showDecimals)
-        : m_useCap(_useCap), m_showDecimal(_showDecimals)
+        : m_formatter(_useCap, _showDecimals)
     {}
 
     void operator()(Circle const& _circle) const
     {
-        if (m_useCap) { std::cout << "CIRCLE: "; }
-        else { std::cout << "circle: "; }
-
-        if (m_showDecimal) { std::cout << std::setprecision(2) << std::fixed; }
-        else { std::cout << std::setprecision(0) << std::fixed; }
-
-        std::cout << "center = (" << _circle.center().x << ", " << _circle.center().y
-            << "), radius = " << _circle.radius() << std::endl;
-
+        write(_circle);
     }
 
     void operator()(Square const& _square) const
     {
-        if (m_useCap) { std::cout << "SQUARE: "; }
-        else { std::cout << "square: "; }
+        write(_square);
+    }
 
-        if (m_showDecimal) { std::cout << std::setprecision(2) << std::fixed; }
-        else { std::cout << std::setprecision(0) << std::fixed; }
+private:
 
-        std::cout << "center = (" << _square.center().x << ", " << _square.center().y
-            << "), side = " << _square.side() << std::endl;
+    // formats the whole line first, then writes it at once
+    template< typename ShapeT >
+    void write(ShapeT const& _shape) const
+    {
+        thread_local std::string line;  // reused: no allocation once large enough
+        line.clear();
+        m_formatter.format(_shape, line);
+        std::cout.write(line.data(), std::streamsize(line.size()));
     }
 
-private:
-    bool m_useCap;
-    bool m_showDecimal;
+    ShapeFormatter m_formatter;
 };
 
 
@@ -125,10 +200,6 @@ public:
         std::cout << "     center = (" << _square.center().x << ", " << _square.center().y << ")" << std::endl;
         std::cout << "     side = " << _square.side() << std::endl;
     }
-
-private:
-    bool m_useCap;
-    bool m_showDecimal;
 };
 
 
@@ -166,6 +237,8 @@ public:
 
 private:
 
+    friend class ShapeConstRef;
+
     // External Polymorphism design pattern:
 
     // Abstract Shape class (defines behavior, e.g., is printable)
@@ -199,6 +272,397 @@ private:
 };
 
 
+/*------------------------------------------------------------------------------------------------------------+
+|                                                  SHAPECONSTREF                                              |
++------------------------------------------------------------------------------------------------------------*/
+
+// Non-owning view on a printable shape: either a ShapeT with its DrawStrategy, or an existing Shape.
+// Binding it never allocates nor copies, and it is cheap to copy: pass it by value.
+// The referenced objects must outlive the view (e.g., temporaries are fine for a function argument).
+class ShapeConstRef
+{
+public:
+
+    template< typename ShapeT, typename DrawStrategy >
+    ShapeConstRef(ShapeT const& _shape, DrawStrategy const& _drawer)
+        : m_shape{ std::addressof(_shape) }
+        , m_drawer{ std::addressof(_drawer) }
+        , m_print{ [](void const* _s, void const* _d) {
+              (*static_cast<DrawStrategy const*>(_d))(*static_cast<ShapeT const*>(_s));
+          } }
+    {}
+
+    // implicit: functions taking a ShapeConstRef also accept a Shape
+    ShapeConstRef(Shape const& _shape)
+        : m_shape{ _shape.m_pImpl.get() }
+        , m_drawer{ nullptr }
+        , m_print{ [](void const* _s, void const*) {
+              static_cast<Shape::Concept const*>(_s)->print_ft();
+          } }
+    {}
+
+    void print() const { m_print(m_shape, m_drawer); }
+
+private:
+    void const* m_shape;
+    void const* m_drawer;
+    void (*m_print)(void const*, void const*);
+};
+
+static_assert(sizeof(ShapeConstRef) == 3 * sizeof(void*));
+
+// hot-path helper: takes a view, works with any shape without copying it
+void printShape(ShapeConstRef _shape)
+{
+    _shape.print();
+}
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                     SBOSHAPE                                                |
++------------------------------------------------------------------------------------------------------------*/
+
+// Same as Shape, with Small Buffer Optimization:
+// models that fit in Capacity bytes are stored inside the SboShape object itself (no allocation, even for copies),
+// larger models fall back to the heap. e.g., Circle + PrintStrategy1 needs 40 bytes (on 64-bit platforms).
+template< std::size_t Capacity = 64, std::size_t Alignment = alignof(std::max_align_t) >
+class SboShape
+{
+public:
+
+    template< typename ShapeT, typename DrawStrategy >
+    SboShape(ShapeT const& _shape, DrawStrategy const& _drawer)
+    {
+        using M = Model< ShapeT, DrawStrategy >;
+        if constexpr (fitsInBuffer<M>) {
+            m_pImpl = ::new (m_buffer) M(_shape, _drawer);
+        }
+        else {
+            m_pImpl = new M(_shape, _drawer);
+        }
+    }
+
+    SboShape(SboShape const& other)
+        : m_pImpl{ other.m_pImpl->clone(m_buffer) }
+    {}
+
+    SboShape(SboShape&& other) noexcept
+        : m_pImpl{ other.m_pImpl->move(m_buffer) }
+    {
+        other.m_pImpl = nullptr;
+    }
+
+    SboShape& operator=(SboShape const& other)
+    {
+        if (this != &other)
+        {
+            SboShape tmp(other);  // copy first: *this is unchanged if it throws
+            *this = std::move(tmp);
+        }
+        return *this;
+    }
+
+    SboShape& operator=(SboShape&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            m_pImpl = other.m_pImpl->move(m_buffer);
+            other.m_pImpl = nullptr;
+        }
+        return *this;
+    }
+
+    ~SboShape() { reset(); }
+
+    void print() const { m_pImpl->print_ft(); }
+
+    // true if the model is stored in the internal buffer
+    bool isInline() const { return m_pImpl->isInline(); }
+
+private:
+
+    template< typename M >
+    static constexpr bool fitsInBuffer = sizeof(M) <= Capacity && alignof(M) <= Alignment
+                                         && std::is_nothrow_move_constructible_v<M>;
+
+    struct Concept
+    {
+        virtual ~Concept() = default;
+        virtual void print_ft() const = 0;
+
+        // copy / move the model into _buffer if it fits, on the heap otherwise
+        virtual Concept* clone(std::byte* _buffer) const = 0;
+        virtual Concept* move(std::byte* _buffer) noexcept = 0;
+        // destroys the model, and frees it if it is on the heap
+        virtual void destroy() noexcept = 0;
+        virtual bool isInline() const noexcept = 0;
+    };
+
+    template< typename ShapeT, typename PrintStrategy >
+    struct Model final : public Concept
+    {
+        explicit Model(ShapeT _shape, PrintStrategy _print)
+            : m_shape(_shape), m_print(_print)
+        {}
+
+        void print_ft() const override {
+            m_print(m_shape); // use provided print strategy
+        }
+
+        Concept* clone(std::byte* _buffer) const override
+        {
+            if constexpr (fitsInBuffer<Model>) { return ::new (_buffer) Model(*this); }
+            else { return new Model(*this); }
+        }
+
+        Concept* move(std::byte* _buffer) noexcept override
+        {
+            if constexpr (fitsInBuffer<Model>)
+            {
+                Concept* moved = ::new (_buffer) Model(std::move(*this));
+                this->~Model();
+                return moved;
+            }
+            else {
+                return this;  // heap model: ownership is simply transferred
+            }
+        }
+
+        void destroy() noexcept override
+        {
+            if constexpr (fitsInBuffer<Model>) { this->~Model(); }
+            else { delete this; }
+        }
+
+        bool isInline() const noexcept override { return fitsInBuffer<Model>; }
+
+        ShapeT m_shape;
+        PrintStrategy m_print;
+    };
+
+    void reset() noexcept
+    {
+        if (m_pImpl != nullptr) {
+            m_pImpl->destroy();
+            m_pImpl = nullptr;
+        }
+    }
+
+    alignas(Alignment) std::byte m_buffer[Capacity];
+    Concept* m_pImpl = nullptr;  // points into m_buffer, or to the heap
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                MANUALVTABLESHAPE                                            |
++------------------------------------------------------------------------------------------------------------*/
+
+// Same as Shape, without a virtual Concept: the handle points to a static table of function pointers,
+// built at compile time for each (ShapeT, DrawStrategy) pair, and the model itself has no vptr.
+// The only hot operation (print) is also stored inline in the handle, so calling it does not even load the table.
+class ManualVtableShape
+{
+public:
+
+    template< typename ShapeT, typename DrawStrategy >
+    ManualVtableShape(ShapeT const& _shape, DrawStrategy const& _drawer)
+        : m_print{ vtable< Model<ShapeT, DrawStrategy> >.print }
+        , m_vtable{ &vtable< Model<ShapeT, DrawStrategy> > }
+        , m_pImpl{ new Model<ShapeT, DrawStrategy>{ _shape, _drawer } }
+    {}
+
+    ManualVtableShape(ManualVtableShape const& other)
+        : m_print{ other.m_print }, m_vtable{ other.m_vtable }, m_pImpl{ other.m_vtable->clone(other.m_pImpl) }
+    {}
+
+    ManualVtableShape(ManualVtableShape&& other) noexcept
+        : m_print{ other.m_print }, m_vtable{ other.m_vtable }, m_pImpl{ other.m_pImpl }
+    {
+        other.m_pImpl = nullptr;
+    }
+
+    ManualVtableShape& operator=(ManualVtableShape const& other)
+    {
+        // Copy-and-swap idiom
+        ManualVtableShape tmp(other);
+        swap(tmp);
+        return *this;
+    }
+
+    ManualVtableShape& operator=(ManualVtableShape&& other) noexcept
+    {
+        ManualVtableShape tmp(std::move(other));
+        swap(tmp);
+        return *this;
+    }
+
+    ~ManualVtableShape()
+    {
+        if (m_pImpl != nullptr) {
+            m_vtable->destroy(m_pImpl);
+        }
+    }
+
+    void print() const { m_print(m_pImpl); }
+
+private:
+
+    // model: data only, no virtual function
+    template< typename ShapeT, typename PrintStrategy >
+    struct Model
+    {
+        ShapeT m_shape;
+        PrintStrategy m_print;
+    };
+
+    struct VTable
+    {
+        void  (*print)(void const*);
+        void* (*clone)(void const*);
+        void  (*destroy)(void*) noexcept;
+    };
+
+    // one constant table per model type
+    template< typename M >
+    static constexpr VTable vtable = {
+        [](void const* _model) { static_cast<M const*>(_model)->m_print(static_cast<M const*>(_model)->m_shape); },
+        [](void const* _model) -> void* { return new M(*static_cast<M const*>(_model)); },
+        [](void* _model) noexcept { delete static_cast<M*>(_model); }
+    };
+
+    void swap(ManualVtableShape& other) noexcept
+    {
+        std::swap(m_print, other.m_print);
+        std::swap(m_vtable, other.m_vtable);
+        std::swap(m_pImpl, other.m_pImpl);
+    }
+
+    void (*m_print)(void const*);  // inline copy of m_vtable->print
+    VTable const* m_vtable;
+    void* m_pImpl;
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                     COWSHAPE                                                |
++------------------------------------------------------------------------------------------------------------*/
+
+// Same as Shape, with Copy-On-Write: copies share the same model (intrusive, atomic reference count)
+// and cost no allocation; the model is only cloned by the first mutating operation on a shared CowShape.
+class CowShape
+{
+public:
+
+    template< typename ShapeT, typename DrawStrategy >
+    CowShape(ShapeT const& _shape, DrawStrategy const& _drawer)
+        : m_pImpl{ new Model< ShapeT, DrawStrategy >(_shape, _drawer) }
+    {}
+
+    CowShape(CowShape const& other) noexcept
+        : m_pImpl{ other.m_pImpl }
+    {
+        if (m_pImpl != nullptr) {
+            m_pImpl->addRef();
+        }
+    }
+
+    CowShape(CowShape&& other) noexcept
+        : m_pImpl{ std::exchange(other.m_pImpl, nullptr) }
+    {}
+
+    CowShape& operator=(CowShape const& other) noexcept
+    {
+        CowShape tmp(other);
+        std::swap(m_pImpl, tmp.m_pImpl);
+        return *this;
+    }
+
+    CowShape& operator=(CowShape&& other) noexcept
+    {
+        CowShape tmp(std::move(other));
+        std::swap(m_pImpl, tmp.m_pImpl);
+        return *this;
+    }
+
+    ~CowShape() { release(); }
+
+    void print() const { m_pImpl->print_ft(); }
+
+    // mutating operation: gets a model of its own first
+    void setCenter(Point _center)
+    {
+        detach();
+        m_pImpl->setCenter(_center);
+    }
+
+    // number of CowShapes sharing the model
+    long useCount() const { return m_pImpl ? m_pImpl->m_refCount.load(std::memory_order_relaxed) : 0; }
+
+private:
+
+    struct Concept
+    {
+        Concept() = default;
+        Concept(Concept const&) {}  // a clone starts with its own count
+        Concept& operator=(Concept const&) = delete;
+
+        virtual ~Concept() = default;
+        virtual void print_ft() const = 0;
+        virtual void setCenter(Point _center) = 0;
+
+        virtual Concept* clone() const = 0;  // Prototype design pattern
+
+        void addRef() const noexcept { m_refCount.fetch_add(1, std::memory_order_relaxed); }
+
+        // returns true if this was the last reference
+        bool removeRef() const noexcept { return m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+        mutable std::atomic<long> m_refCount{ 1 };
+    };
+
+    template< typename ShapeT, typename PrintStrategy >
+    struct Model : public Concept
+    {
+        explicit Model(ShapeT _shape, PrintStrategy _print)
+            : m_shape(_shape), m_print(_print)
+        {}
+
+        void print_ft() const override {
+            m_print(m_shape); // use provided print strategy
+        }
+
+        void setCenter(Point _center) override { m_shape.setCenter(_center); }
+
+        Concept* clone() const override { return new Model(*this); }
+
+        ShapeT m_shape;
+        PrintStrategy m_print;
+    };
+
+    // clones the model if it is shared
+    void detach()
+    {
+        if (m_pImpl->m_refCount.load(std::memory_order_acquire) != 1)
+        {
+            Concept* copy = m_pImpl->clone();
+            release();
+            m_pImpl = copy;
+        }
+    }
+
+    void release() noexcept
+    {
+        if (m_pImpl != nullptr && m_pImpl->removeRef()) {
+            delete m_pImpl;
+        }
+        m_pImpl = nullptr;
+    }
+
+    Concept* m_pImpl;  // shared, immutable while shared
+};
+
+
 /*------------------------------------------------------------------------------------------------------------+
 |                                                      MAIN                                                   |
 +------------------------------------------------------------------------------------------------------------*/
@@ -226,5 +690,58 @@ int main()
         shape.print();
     }
 
+    std::cout << std::endl;
+
+    // Small Buffer Optimization: copies of small models do not allocate
+    std::vector< SboShape<> > sboShapes;
+    sboShapes.reserve(4);
+
+    SboShape<> sboCircle(Circle(Point(6.0, 6.0), 16.0), PrintStrategy1(false, true));
+    SboShape<> sboSquare(Square(Point(7.0, 7.0), 17.0), PrintStrategy2());
+    SboShape<32> smallCircle(Circle(Point(8.0, 8.0), 18.0), PrintStrategy1(false, false));  // too small: on the heap
+
+    sboShapes.insert(sboShapes.end(), { sboCircle, sboSquare, sboCircle });
+
+    for (auto const& shape : sboShapes) {
+        shape.print();
+    }
+    smallCircle.print();
+
+    std::cout << "sizeof(SboShape<>) = " << sizeof(SboShape<>) << ", inline: " << std::boolalpha << sboShapes[0].isInline()
+              << "; sizeof(SboShape<32>) = " << sizeof(SboShape<32>) << ", inline: " << smallCircle.isInline() << std::endl;
+
+    std::cout << std::endl;
+
+    // manual vtable: no virtual function involved
+    std::vector<ManualVtableShape> manualShapes;
+    manualShapes.emplace_back(Circle(Point(9.0, 9.0), 19.0), PrintStrategy1(true, true));
+    manualShapes.emplace_back(Square(Point(10.0, 10.0), 20.0), PrintStrategy2());
+    manualShapes.push_back(manualShapes[0]);
+
+    for (auto const& shape : manualShapes) {
+        shape.print();
+    }
+
+    std::cout << std::endl;
+
+    // copy-on-write: copies share their model until one of them is modified
+    CowShape cowCircle(Circle(Point(11.0, 11.0), 21.0), PrintStrategy1(false, true));
+    std::vector<CowShape> snapshot(3, cowCircle);
+    std::cout << "shared by " << cowCircle.useCount() << " shapes" << std::endl;
+
+    snapshot[0].setCenter(Point(12.0, 12.0));  // clones the model
+    std::cout << "shared by " << cowCircle.useCount() << " shapes" << std::endl;
+    cowCircle.print();
+    snapshot[0].print();
+
+    std::cout << std::endl;
+
+    // non-owning views: no allocation, no copy
+    printShape(circle1);
+    printShape(ShapeConstRef(Circle(Point(13.0, 13.0), 23.0), PrintStrategy1(true, false)));
+    Square square4(Point(14.0, 14.0), 24.0);
+    PrintStrategy2 printer;
+    printShape(ShapeConstRef(square4, printer));
+
     return EXIT_SUCCESS;
 }
@@ -9,6 +9,19 @@
 
 #include <iostream>
 #include <vector>
+#include <memory>
+#include <span>
+#include <memory_resource>
+#include <new>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <optional>
+#include <algorithm>
+#include <cstdint>
+#include <cassert>
 # define _USE_MATH_DEFINES
 #include <math.h>
 
@@ -36,6 +49,11 @@ class ShapeVisitor
    virtual void visit( Circle const& ) const = 0;
    // visit Square
    virtual void visit( Square const& ) const = 0;
+
+   // visit a whole group of Circles / Squares with a single virtual call
+   // (default: one visit() per shape, override to avoid the per-shape virtual call)
+   virtual void visitBatch( std::span<Circle const* const> _circles ) const;
+   virtual void visitBatch( std::span<Square const* const> _squares ) const;
 };
 
 
@@ -107,6 +125,275 @@ class Square : public Shape
 };
 
 
+/*------------------------------------------------------------------------------------------------------------+
+|                                                   ARENASHAPES                                               |
++-------------------------------------------------------------------------------------------------------------*/
+
+// Alternative to Shapes: polymorphic shapes placement-constructed next to each other in an arena
+// (std::pmr::monotonic_buffer_resource) instead of one heap allocation each.
+// clear() destroys all the shapes and gives the arena's few large blocks back at once, without one free() per shape.
+class ArenaShapes
+{
+ public:
+   explicit ArenaShapes( std::size_t _blockSize = 64 * 1024 )
+      : m_arena( _blockSize )
+   {}
+
+   // _buffer is used first (and kept across clear()), e.g., to rebuild scenes without allocating at all
+   explicit ArenaShapes( std::span<std::byte> _buffer )
+      : m_arena( _buffer.data(), _buffer.size() )
+   {}
+
+   ~ArenaShapes() { clear(); }
+
+   ArenaShapes( ArenaShapes const& ) = delete;
+   ArenaShapes& operator=( ArenaShapes const& ) = delete;
+
+   // constructs a ShapeT in the arena
+   template< typename ShapeT, typename... Args >
+   ShapeT& emplace( Args&&... _args )
+   {
+      m_shapes.push_back( nullptr );  // so that a throw from push_back cannot leak a constructed shape
+      try
+      {
+         void* memory = m_arena.allocate( sizeof(ShapeT), alignof(ShapeT) );
+         ShapeT* shape = ::new( memory ) ShapeT( std::forward<Args>(_args)... );
+         m_shapes.back() = shape;
+         return *shape;
+      }
+      catch( ... )
+      {
+         m_shapes.pop_back();
+         throw;
+      }
+   }
+
+   // destroys all shapes (virtual destructors) and releases the arena memory in bulk
+   void clear()
+   {
+      for( Shape* shape : m_shapes ) {
+         shape->~Shape();
+      }
+      m_shapes.clear();
+      m_arena.release();
+   }
+
+   std::size_t size() const { return m_shapes.size(); }
+   std::span<Shape* const> shapes() const { return m_shapes; }
+
+ private:
+   std::pmr::monotonic_buffer_resource m_arena;
+   std::vector<Shape*> m_shapes;
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                   SHAPEGROUPS                                               |
++-------------------------------------------------------------------------------------------------------------*/
+
+void ShapeVisitor::visitBatch( std::span<Circle const* const> _circles ) const
+{
+   for( auto circle : _circles ) {
+      visit( *circle );
+   }
+}
+
+void ShapeVisitor::visitBatch( std::span<Square const* const> _squares ) const
+{
+   for( auto square : _squares ) {
+      visit( *square );
+   }
+}
+
+// Shapes bucketed by dynamic type (once, with one accept() per shape):
+// each group then goes through a visitor with a single virtual call
+class ShapeGroups
+{
+ public:
+   explicit ShapeGroups( Shapes const& _shapes )
+   {
+      GroupingVisitor grouping( *this );
+      for( auto const& shape : _shapes ) {
+         shape->accept( grouping );
+      }
+   }
+
+   explicit ShapeGroups( ArenaShapes const& _shapes )
+   {
+      GroupingVisitor grouping( *this );
+      for( Shape* shape : _shapes.shapes() ) {
+         shape->accept( grouping );
+      }
+   }
+
+   // accept visitor, one group at a time
+   void accept( ShapeVisitor const& _v ) const
+   {
+      _v.visitBatch( m_circles );
+      _v.visitBatch( m_squares );
+   }
+
+   std::span<Circle const* const> circles() const { return m_circles; }
+   std::span<Square const* const> squares() const { return m_squares; }
+
+ private:
+
+   // puts each visited shape in the group of its type
+   class GroupingVisitor : public ShapeVisitor
+   {
+    public:
+      explicit GroupingVisitor( ShapeGroups& _groups ) : m_groups( &_groups ) {}
+
+      void visit( Circle const& _circle ) const override { m_groups->m_circles.push_back( &_circle ); }
+      void visit( Square const& _square ) const override { m_groups->m_squares.push_back( &_square ); }
+
+    private:
+      ShapeGroups* m_groups;
+   };
+
+   // shapes are still owned by the Shapes they come from
+   std::vector<Circle const*> m_circles;
+   std::vector<Square const*> m_squares;
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                              WORKSTEALINGSCHEDULER                                          |
++-------------------------------------------------------------------------------------------------------------*/
+
+// Parallel loop with adaptive splitting and work stealing, for uneven per-shape costs.
+// Each worker owns a deque of index ranges: it splits its current range in halves (pushing the second half
+// on the back of its deque) until it is small enough, processes it, then pops the back of its deque.
+// An idle worker steals from the front of another worker's deque, i.e., the largest pending range,
+// so a few expensive shapes cannot leave the other cores idle as with static chunking.
+class WorkStealingScheduler
+{
+ public:
+   // _nbThreads = 0: one worker per hardware thread
+   explicit WorkStealingScheduler( unsigned _nbThreads = 0 )
+      : m_nbThreads( _nbThreads ? _nbThreads : std::max( 1u, std::thread::hardware_concurrency() ) )
+   {}
+
+   unsigned nbThreads() const { return m_nbThreads; }
+
+   // calls _fn(i, worker) for every i in [0, _size), ranges are not split below _grain indices.
+   // worker, in [0, nbThreads()), identifies the thread making the call, e.g., to accumulate per worker
+   // without sharing a cache line (_fn is called concurrently and must not throw)
+   template< typename Fn >
+   void parallelFor( std::size_t _size, std::size_t _grain, Fn const& _fn ) const
+   {
+      _grain = std::max<std::size_t>( _grain, 1 );
+      const unsigned nbWorkers = static_cast<unsigned>( std::min<std::size_t>( m_nbThreads, std::max<std::size_t>( _size / _grain, 1 ) ) );
+
+      std::vector<WorkerQueue> queues( nbWorkers );
+      for( unsigned w = 0; w < nbWorkers; ++w ) {
+         queues[w].ranges.push_back( { _size * w / nbWorkers, _size * (w + 1) / nbWorkers } );
+      }
+      std::atomic<std::size_t> nbRemaining{ _size };
+
+      // bumped when a range becomes stealable or when all the work is done: idle workers wait on it
+      std::atomic<std::uint32_t> workEpoch{ 0 };
+      auto signalWork = [&workEpoch]()
+      {
+         workEpoch.fetch_add( 1, std::memory_order_release );
+         workEpoch.notify_all();
+      };
+
+      auto worker = [&]( unsigned _self )
+      {
+         unsigned nbFailedSteals = 0;
+         while( nbRemaining.load() > 0 )
+         {
+            const std::uint32_t epoch = workEpoch.load( std::memory_order_acquire );
+            std::optional<Range> range = queues[_self].popBack();
+            for( unsigned v = 1; !range && v < nbWorkers; ++v ) {
+               range = queues[(_self + v) % nbWorkers].popFront();  // steal
+            }
+            if( !range )
+            {
+               // nothing to steal: spin briefly, then sleep until a range is pushed or the loop ends
+               if( ++nbFailedSteals < 16 ) {
+                  std::this_thread::yield();
+               }
+               else if( nbRemaining.load() > 0 ) {
+                  workEpoch.wait( epoch, std::memory_order_acquire );
+               }
+               continue;
+            }
+            nbFailedSteals = 0;
+
+            // keep the first half, leave the second half to be stolen
+            bool hasPushed = false;
+            while( range->end - range->begin > _grain )
+            {
+               const std::size_t middle = range->begin + (range->end - range->begin) / 2;
+               queues[_self].pushBack( { middle, range->end } );
+               range->end = middle;
+               hasPushed = true;
+            }
+            if( hasPushed ) {
+               signalWork();
+            }
+
+            for( std::size_t i = range->begin; i < range->end; ++i ) {
+               _fn( i, _self );
+            }
+            if( nbRemaining.fetch_sub( range->end - range->begin ) == range->end - range->begin ) {
+               signalWork();  // last range done: wakes up the idle workers so they can exit
+            }
+         }
+      };
+
+      std::vector<std::jthread> threads;
+      for( unsigned w = 1; w < nbWorkers; ++w ) {
+         threads.emplace_back( worker, w );
+      }
+      worker( 0 ); // calling thread works too
+   }
+
+ private:
+
+   struct Range
+   {
+      std::size_t begin;
+      std::size_t end;
+   };
+
+   // owner pushes and pops at the back, thieves pop at the front
+   struct WorkerQueue
+   {
+      std::mutex mutex;
+      std::deque<Range> ranges;
+
+      void pushBack( Range _range )
+      {
+         std::lock_guard lock( mutex );
+         ranges.push_back( _range );
+      }
+
+      std::optional<Range> popBack()
+      {
+         std::lock_guard lock( mutex );
+         if( ranges.empty() ) { return std::nullopt; }
+         Range range = ranges.back();
+         ranges.pop_back();
+         return range;
+      }
+
+      std::optional<Range> popFront()
+      {
+         std::lock_guard lock( mutex );
+         if( ranges.empty() ) { return std::nullopt; }
+         Range range = ranges.front();
+         ranges.pop_front();
+         return range;
+      }
+   };
+
+   unsigned m_nbThreads;
+};
+
+
 /*------------------------------------------------------------------------------------------------------------+
 |                                                   AREAVISITOR                                               |
 +-------------------------------------------------------------------------------------------------------------*/
@@ -132,12 +419,57 @@ public:
             << ", area = " << _square.side() * m_scale * _square.side() * m_scale << std::endl;
     }
 
+    // batch versions: qualified calls, no virtual call per shape
+    void visitBatch(std::span<Circle const* const> _circles) const override
+    {
+        for (auto circle : _circles) {
+            AreaVisitor::visit(*circle);
+        }
+    }
+
+    void visitBatch(std::span<Square const* const> _squares) const override
+    {
+        for (auto square : _squares) {
+            AreaVisitor::visit(*square);
+        }
+    }
+
 private:
     double m_scale = 1.0;
 
 };
 
 
+/*------------------------------------------------------------------------------------------------------------+
+|                                                  AREASUMVISITOR                                             |
++-------------------------------------------------------------------------------------------------------------*/
+
+// Accumulates the areas of the visited shapes.
+// Not shared between threads: use one per worker (see parallelVisitAllShapes) and add up their totals;
+// aligned on a cache line so that neighbouring visitors do not falsely share it.
+class alignas(64) AreaSumVisitor : public ShapeVisitor
+{
+public:
+    explicit AreaSumVisitor(double _scale = 1.0) : m_scale(_scale) {}
+
+    void visit(Circle const& _circle) const override
+    {
+        m_total += M_PI * pow(_circle.radius() * m_scale, 2);
+    }
+
+    void visit(Square const& _square) const override
+    {
+        m_total += _square.side() * m_scale * _square.side() * m_scale;
+    }
+
+    double total() const { return m_total; }
+
+private:
+    double m_scale = 1.0;
+    mutable double m_total = 0.0;
+};
+
+
 /*------------------------------------------------------------------------------------------------------------+
 |                                                      MAIN                                                   |
 +-------------------------------------------------------------------------------------------------------------*/
@@ -150,6 +482,39 @@ void areaAllShapes( Shapes const& _shapes )
    }
 }
 
+void areaAllShapes( ArenaShapes const& _shapes )
+{
+   for( Shape* shape : _shapes.shapes() )
+   {
+      shape->accept(AreaVisitor(1.0));
+   }
+}
+
+void areaAllShapes( ShapeGroups const& _groups )
+{
+   _groups.accept(AreaVisitor(1.0));
+}
+
+// applies _visitor on all shapes, in parallel (_visitor must be safe to call concurrently)
+void parallelVisitAllShapes( Shapes const& _shapes, ShapeVisitor const& _visitor,
+                             WorkStealingScheduler const& _scheduler, std::size_t _grain = 64 )
+{
+   _scheduler.parallelFor( _shapes.size(), _grain, [&]( std::size_t _i, unsigned ) {
+      _shapes[_i]->accept( _visitor );
+   });
+}
+
+// same, with one visitor per worker (_visitors.size() >= _scheduler.nbThreads()): no state shared between threads
+template< typename VisitorT >
+void parallelVisitAllShapes( Shapes const& _shapes, std::span<VisitorT> _visitors,
+                             WorkStealingScheduler const& _scheduler, std::size_t _grain = 64 )
+{
+   assert( _visitors.size() >= _scheduler.nbThreads() );
+   _scheduler.parallelFor( _shapes.size(), _grain, [&]( std::size_t _i, unsigned _worker ) {
+      _shapes[_i]->accept( _visitors[_worker] );
+   });
+}
+
 int main()
 {
    Shapes shapes{};
@@ -160,5 +525,89 @@ int main()
 
    areaAllShapes( shapes );
 
+   std::cout << std::endl;
+
+   // same shapes, visited group by group
+   ShapeGroups groups( shapes );
+   areaAllShapes( groups );
+
+   std::cout << std::endl;
+
+   // same shapes, allocated in an arena
+   ArenaShapes arenaShapes;
+   arenaShapes.emplace<Circle>( 2.3 );
+   arenaShapes.emplace<Square>( 1.2 );
+   arenaShapes.emplace<Circle>( 4.1 );
+   areaAllShapes( arenaShapes );
+
+   std::cout << std::endl;
+
+   // scene rebuilds: one heap allocation per shape vs arena
+   const std::size_t nbShapes = 100'000;
+   const int nbRebuilds = 20;
+
+   auto start = std::chrono::steady_clock::now();
+   for( int rebuild = 0; rebuild < nbRebuilds; ++rebuild )
+   {
+      Shapes scene{};
+      scene.reserve( nbShapes );
+      for( std::size_t i = 0; i < nbShapes; ++i ) {
+         if( i % 2 ) { scene.emplace_back( std::make_unique<Circle>( 1.0 ) ); }
+         else { scene.emplace_back( std::make_unique<Square>( 1.0 ) ); }
+      }
+   }
+   const double heapMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+   start = std::chrono::steady_clock::now();
+   {
+      std::vector<std::byte> sceneBuffer( nbShapes * sizeof(Circle) );  // reused by every rebuild
+      ArenaShapes scene( sceneBuffer );
+      for( int rebuild = 0; rebuild < nbRebuilds; ++rebuild )
+      {
+         scene.clear();
+         for( std::size_t i = 0; i < nbShapes; ++i ) {
+            if( i % 2 ) { scene.emplace<Circle>( 1.0 ); }
+            else { scene.emplace<Square>( 1.0 ); }
+         }
+      }
+   }
+   const double arenaMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+   std::cout << nbRebuilds << " rebuilds of " << nbShapes << " shapes: Shapes " << heapMs
+             << " ms, ArenaShapes " << arenaMs << " ms" << std::endl;
+
+   // parallel visit with work stealing
+   Shapes scene{};
+   for( std::size_t i = 0; i < nbShapes; ++i ) {
+      if( i % 2 ) { scene.emplace_back( std::make_unique<Circle>( 1.0 ) ); }
+      else { scene.emplace_back( std::make_unique<Square>( 1.0 ) ); }
+   }
+   WorkStealingScheduler scheduler;
+   std::vector<AreaSumVisitor> areaSums( scheduler.nbThreads(), AreaSumVisitor( 1.0 ) );
+   parallelVisitAllShapes( scene, std::span<AreaSumVisitor>( areaSums ), scheduler );
+   double totalArea = 0.0;
+   for( auto const& areaSum : areaSums ) {
+      totalArea += areaSum.total();
+   }
+   std::cout << "total area (" << scheduler.nbThreads() << " threads) = " << totalArea << std::endl;
+
+   // uneven workload: the first 1% of the indices cost ~100x more; idle workers steal or sleep, they do not spin
+   struct alignas(64) WorkerCount { std::size_t nbDone = 0; double sink = 0.0; };
+   std::vector<WorkerCount> counts( scheduler.nbThreads() );
+   start = std::chrono::steady_clock::now();
+   scheduler.parallelFor( nbShapes, 64, [&]( std::size_t _i, unsigned _worker ) {
+      const int cost = _i < nbShapes / 100 ? 10000 : 100;
+      for( int k = 0; k < cost; ++k ) {
+         counts[_worker].sink += std::sqrt( double( _i + k ) );
+      }
+      ++counts[_worker].nbDone;
+   });
+   const double unevenMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+   std::cout << "uneven workload: " << unevenMs << " ms, shapes per worker:";
+   for( auto const& count : counts ) {
+      std::cout << " " << count.nbDone;
+   }
+   std::cout << std::endl;
+
    return EXIT_SUCCESS;
 }
@@ -12,6 +12,55 @@
 #include <variant>
 #include <vector>
 #include <numbers>
+#include <span>
+#include <chrono>
+#include <random>
+#include <type_traits>
+#include <cassert>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <string_view>
+#include <fstream>
+#include <filesystem>
+#include <array>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+#include <tuple>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define AREA_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang need the target attribute to emit AVX2 code in a single function, MSVC does not
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
 
 
 struct Point
@@ -20,6 +69,13 @@ struct Point
     double y;
 };
 
+// base and height of a Triangle, stored side by side
+struct BaseHeight
+{
+    double base;
+    double height;
+};
+
 
 
 /*------------------------------------------------------------------------------------------------------------+
@@ -34,6 +90,10 @@ public:
         :m_center()
     {}
 
+    explicit ShapeData(Point _center)
+        :m_center(_center)
+    {}
+
     virtual ~ShapeData() = default;
 
     // no need for accept() function anymore
@@ -57,6 +117,10 @@ class Circle : public ShapeData
       : m_radius( _radius )
    {}
 
+   explicit Circle( double _radius, Point _center )
+      : ShapeData( _center ), m_radius( _radius )
+   {}
+
    double radius() const { return m_radius; }
 
  private:
@@ -75,6 +139,10 @@ class Square : public ShapeData
       : m_side( _side )
    {}
 
+   explicit Square( double _side, Point _center )
+      : ShapeData( _center ), m_side( _side )
+   {}
+
    double side() const { return m_side; }
 
  private:
@@ -93,6 +161,10 @@ public:
         : m_base(_base), m_height(_height)
     {}
 
+    explicit Triangle(double _base, double _height, Point _center)
+        : ShapeData(_center), m_base(_base), m_height(_height)
+    {}
+
     double base() const { return m_base; }
     double height() const { return m_height; }
 
@@ -134,6 +206,281 @@ public:
 };
 
 
+/*------------------------------------------------------------------------------------------------------------+
+|                                               BUFFEREDPRINTVISITOR                                          |
++------------------------------------------------------------------------------------------------------------*/
+
+// Same output as PrintVisitor, but formatted with std::to_chars into a caller-supplied buffer,
+// which is written out in one block when full (or on flush()) instead of one std::endl flush per shape.
+// The buffer can be reused from one dump to the next: printing does not allocate.
+class BufferedPrintVisitor
+{
+public:
+    // longest line written for one shape
+    static constexpr std::size_t maxLineSize = 128;
+
+    // _buffer must hold at least maxLineSize characters
+    explicit BufferedPrintVisitor(std::span<char> _buffer, std::FILE* _out = stdout)
+        : m_buffer(_buffer), m_out(_out)
+    {
+        assert(_buffer.size() >= maxLineSize);
+    }
+
+    ~BufferedPrintVisitor() { flush(); }
+
+    // two visitors must not share the same buffer
+    BufferedPrintVisitor(BufferedPrintVisitor const&) = delete;
+    BufferedPrintVisitor& operator=(BufferedPrintVisitor const&) = delete;
+
+    // print Circle data
+    void operator()(Circle const& _circle)
+    {
+        reserveLine();
+        append("circle: radius=");
+        append(_circle.radius());
+        append('\n');
+    }
+
+    // print Square data
+    void operator()(Square const& _square)
+    {
+        reserveLine();
+        append("square: side=");
+        append(_square.side());
+        append('\n');
+    }
+
+    // print Triangle data
+    void operator()(Triangle const& _triangle)
+    {
+        reserveLine();
+        append("triangle: base=");
+        append(_triangle.base());
+        append(", height=");
+        append(_triangle.height());
+        append('\n');
+    }
+
+    // writes the buffered text
+    void flush()
+    {
+        writeBlock();
+        std::fflush(m_out);
+    }
+
+    std::size_t nbBlockWrites() const { return m_nbBlockWrites; }
+    std::size_t nbBytesWritten() const { return m_nbBytesWritten; }
+
+private:
+
+    void writeBlock()
+    {
+        if (m_size == 0) {
+            return;
+        }
+        std::fwrite(m_buffer.data(), 1, m_size, m_out);
+        m_nbBlockWrites++;
+        m_nbBytesWritten += m_size;
+        m_size = 0;
+    }
+
+    // makes sure a whole line fits in the buffer
+    void reserveLine()
+    {
+        if (m_buffer.size() - m_size < maxLineSize) {
+            writeBlock();
+        }
+    }
+
+    void append(std::string_view _text)
+    {
+        std::copy(_text.begin(), _text.end(), m_buffer.data() + m_size);
+        m_size += _text.size();
+    }
+
+    void append(char _c)
+    {
+        m_buffer[m_size++] = _c;
+    }
+
+    // same format as std::cout with default settings (6 significant digits)
+    void append(double _value)
+    {
+        auto result = std::to_chars(m_buffer.data() + m_size, m_buffer.data() + m_buffer.size(),
+                                    _value, std::chars_format::general, 6);
+        m_size = static_cast<std::size_t>(result.ptr - m_buffer.data());
+    }
+
+    std::span<char> m_buffer;
+    std::FILE* m_out;
+    std::size_t m_size = 0;
+    std::size_t m_nbBlockWrites = 0;
+    std::size_t m_nbBytesWritten = 0;
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                  EXTENTVISITOR                                              |
++------------------------------------------------------------------------------------------------------------*/
+
+class ExtentVisitor
+{
+public:
+    explicit ExtentVisitor() {}
+
+    ~ExtentVisitor() = default;
+
+    // return the half size of the axis-aligned bounding box of a shape, around its center
+
+    Point operator()(Circle const& _circle) const
+    {
+        return { _circle.radius(), _circle.radius() };
+    }
+
+    Point operator()(Square const& _square) const
+    {
+        return { _square.side() * 0.5, _square.side() * 0.5 };
+    }
+
+    // the center of a Triangle may be anywhere inside its bounding box: use a conservative extent
+    Point operator()(Triangle const& _triangle) const
+    {
+        return { _triangle.base(), _triangle.height() };
+    }
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                   AREAKERNELS                                               |
++------------------------------------------------------------------------------------------------------------*/
+
+// Batch area computations, used by AreaVisitor on whole columns of shapes.
+// All the areas are either  factor * x * x  (Circle, Square) or  factor * base * height  (Triangle),
+// so two kernels are enough. The best implementation is chosen once, at runtime, depending on the CPU.
+
+// _out[i] = (_in[i] * _in[i]) * _factor
+using SquareKernel = void (*)(double const* _in, double* _out, std::size_t _size, double _factor);
+// _out[i] = (_in[2i] * _in[2i+1]) * _factor
+using PairProductKernel = void (*)(double const* _in, double* _out, std::size_t _size, double _factor);
+
+void squareScalar(double const* _in, double* _out, std::size_t _size, double _factor)
+{
+    for (std::size_t i = 0; i < _size; ++i) {
+        _out[i] = (_in[i] * _in[i]) * _factor;
+    }
+}
+
+void pairProductScalar(double const* _in, double* _out, std::size_t _size, double _factor)
+{
+    for (std::size_t i = 0; i < _size; ++i) {
+        _out[i] = (_in[2 * i] * _in[2 * i + 1]) * _factor;
+    }
+}
+
+#ifdef AREA_KERNELS_X86
+
+// SSE2 is always available on x86-64: 2 doubles per instruction
+void squareSSE2(double const* _in, double* _out, std::size_t _size, double _factor)
+{
+    const __m128d factor = _mm_set1_pd(_factor);
+    std::size_t i = 0;
+    for (; i + 2 <= _size; i += 2)
+    {
+        __m128d x = _mm_loadu_pd(_in + i);
+        _mm_storeu_pd(_out + i, _mm_mul_pd(_mm_mul_pd(x, x), factor));
+    }
+    squareScalar(_in + i, _out + i, _size - i, _factor);
+}
+
+void pairProductSSE2(double const* _in, double* _out, std::size_t _size, double _factor)
+{
+    const __m128d factor = _mm_set1_pd(_factor);
+    std::size_t i = 0;
+    for (; i + 2 <= _size; i += 2)
+    {
+        __m128d p0 = _mm_loadu_pd(_in + 2 * i);      // b0 h0
+        __m128d p1 = _mm_loadu_pd(_in + 2 * i + 2);  // b1 h1
+        __m128d bases = _mm_unpacklo_pd(p0, p1);      // b0 b1
+        __m128d heights = _mm_unpackhi_pd(p0, p1);    // h0 h1
+        _mm_storeu_pd(_out + i, _mm_mul_pd(_mm_mul_pd(bases, heights), factor));
+    }
+    pairProductScalar(_in + 2 * i, _out + i, _size - i, _factor);
+}
+
+// AVX2: 4 doubles per instruction
+TARGET_AVX2 void squareAVX2(double const* _in, double* _out, std::size_t _size, double _factor)
+{
+    const __m256d factor = _mm256_set1_pd(_factor);
+    std::size_t i = 0;
+    for (; i + 4 <= _size; i += 4)
+    {
+        __m256d x = _mm256_loadu_pd(_in + i);
+        _mm256_storeu_pd(_out + i, _mm256_mul_pd(_mm256_mul_pd(x, x), factor));
+    }
+    squareScalar(_in + i, _out + i, _size - i, _factor);
+}
+
+TARGET_AVX2 void pairProductAVX2(double const* _in, double* _out, std::size_t _size, double _factor)
+{
+    const __m256d factor = _mm256_set1_pd(_factor);
+    std::size_t i = 0;
+    for (; i + 4 <= _size; i += 4)
+    {
+        __m256d p01 = _mm256_loadu_pd(_in + 2 * i);      // b0 h0 b1 h1
+        __m256d p23 = _mm256_loadu_pd(_in + 2 * i + 4);  // b2 h2 b3 h3
+        __m256d bases = _mm256_unpacklo_pd(p01, p23);     // b0 b2 b1 b3
+        __m256d heights = _mm256_unpackhi_pd(p01, p23);   // h0 h2 h1 h3
+        __m256d products = _mm256_mul_pd(bases, heights);
+        products = _mm256_permute4x64_pd(products, _MM_SHUFFLE(3, 1, 2, 0)); // back to 0 1 2 3
+        _mm256_storeu_pd(_out + i, _mm256_mul_pd(products, factor));
+    }
+    pairProductScalar(_in + 2 * i, _out + i, _size - i, _factor);
+}
+
+bool cpuHasAVX2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {  // OS must save the YMM registers
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // AREA_KERNELS_X86
+
+
+struct AreaKernels
+{
+    SquareKernel square;
+    PairProductKernel pairProduct;
+    char const* name;
+};
+
+// selected once, on first use
+AreaKernels const& areaKernels()
+{
+    static const AreaKernels kernels = []() -> AreaKernels {
+#ifdef AREA_KERNELS_X86
+        if (cpuHasAVX2()) {
+            return { squareAVX2, pairProductAVX2, "AVX2" };
+        }
+        return { squareSSE2, pairProductSSE2, "SSE2" };
+#else
+        return { squareScalar, pairProductScalar, "scalar" };
+#endif
+    }();
+    return kernels;
+}
+
+
 /*------------------------------------------------------------------------------------------------------------+
 |                                                   AREAVISITOR                                               |
 +------------------------------------------------------------------------------------------------------------*/
@@ -165,43 +512,1469 @@ class AreaVisitor
        return _triangle.base() * m_scale * _triangle.height() * m_scale * 0.5;
    }
 
+   // batch versions: compute the areas of whole columns of scaled shapes at once
+   // (_areas must be at least as large as the input)
+
+   void circleAreas(std::span<const double> _radii, std::span<double> _areas) const
+   {
+       assert(_areas.size() >= _radii.size());
+       areaKernels().square(_radii.data(), _areas.data(), _radii.size(), std::numbers::pi * m_scale * m_scale);
+   }
+
+   void squareAreas(std::span<const double> _sides, std::span<double> _areas) const
+   {
+       assert(_areas.size() >= _sides.size());
+       areaKernels().square(_sides.data(), _areas.data(), _sides.size(), m_scale * m_scale);
+   }
+
+   void triangleAreas(std::span<const BaseHeight> _dims, std::span<double> _areas) const
+   {
+       static_assert(sizeof(BaseHeight) == 2 * sizeof(double), "BaseHeight must be two packed doubles");
+       assert(_areas.size() >= _dims.size());
+       // the column is read as interleaved (base, height) doubles; data() may be null when it is empty
+       areaKernels().pairProduct(reinterpret_cast<double const*>(_dims.data()), _areas.data(), _dims.size(),
+                                 0.5 * m_scale * m_scale);
+   }
+
 private:
     double m_scale = 1.0;
 };
 
 
 /*------------------------------------------------------------------------------------------------------------+
-|                                                      MAIN                                                   |
+|                                                      SHAPES                                                 |
 +------------------------------------------------------------------------------------------------------------*/
 
 // a Shape is either a Circle, a Square, or a Triangle
 using Shape = std::variant<Circle, Square, Triangle>;
 using Shapes = std::vector< Shape >;
 
-void visitAllShapes( Shapes const& _shapes )
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                    SHAPESTORE                                               |
++------------------------------------------------------------------------------------------------------------*/
+
+// Non-owning view on shape columns (owned by a ShapeStore, or mapped from a shape file)
+struct ShapeColumns
 {
-    for (auto const& shape : _shapes)
+    std::span<const double>     circleRadii;
+    std::span<const Point>      circleCenters;
+    std::span<const double>     squareSides;
+    std::span<const Point>      squareCenters;
+    std::span<const BaseHeight> triangleDims;
+    std::span<const Point>      triangleCenters;
+
+    std::size_t size() const { return circleRadii.size() + squareSides.size() + triangleDims.size(); }
+
+    // applies _visitor on all Circles, then all Squares, then all Triangles,
+    // and passes the value returned by each call (if any) to _sink
+    template< typename Visitor, typename Sink >
+    void visit(Visitor&& _visitor, Sink&& _sink) const
     {
-        // std::visit calls a callable (visitor) onto a variant (shape)
-        // https://en.cppreference.com/w/cpp/utility/variant/visit
+        visitColumn(_visitor, _sink, circleRadii.size(),
+            [this](std::size_t _i) { return Circle(circleRadii[_i], circleCenters[_i]); });
+        visitColumn(_visitor, _sink, squareSides.size(),
+            [this](std::size_t _i) { return Square(squareSides[_i], squareCenters[_i]); });
+        visitColumn(_visitor, _sink, triangleDims.size(),
+            [this](std::size_t _i) { return Triangle(triangleDims[_i].base, triangleDims[_i].height, triangleCenters[_i]); });
+    }
+
+    template< typename Visitor >
+    void visit(Visitor&& _visitor) const
+    {
+        visit(_visitor, [](auto&&...) {});
+    }
+
+    // batch computation of all the areas, in the same order as visit()
+    // (_areas must hold at least size() values)
+    void areas(AreaVisitor const& _visitor, std::span<double> _areas) const
+    {
+        assert(_areas.size() >= size());
+        _visitor.circleAreas(circleRadii, _areas);
+        _visitor.squareAreas(squareSides, _areas.subspan(circleRadii.size()));
+        _visitor.triangleAreas(triangleDims, _areas.subspan(circleRadii.size() + squareSides.size()));
+    }
+
+    // shapes are rebuilt on the stack from their columns, so the visitors keep their usual interface
+    template< typename Visitor, typename Sink, typename MakeShape >
+    static void visitColumn(Visitor& _visitor, Sink& _sink, std::size_t _size, MakeShape _makeShape)
+    {
+        for (std::size_t i = 0; i < _size; ++i)
+        {
+            if constexpr (std::is_void_v< decltype(_visitor(_makeShape(i))) >) {
+                _visitor(_makeShape(i));
+            }
+            else {
+                _sink(_visitor(_makeShape(i)));
+            }
+        }
+    }
+};
+
+// Columnar (structure-of-arrays) alternative to Shapes:
+// each shape type is stored in its own contiguous columns (no variant index, no padding to the largest type),
+// and visitors are applied one type-homogeneous column at a time (no per-element dispatch)
+class ShapeStore
+{
+public:
+    ShapeStore() = default;
+
+    explicit ShapeStore(Shapes const& _shapes)
+    {
+        // count each type first, so that every column is allocated only once
+        std::size_t nbPerType[std::variant_size_v<Shape>] = {};
+        for (auto const& shape : _shapes) {
+            nbPerType[shape.index()]++;
+        }
+        reserve(nbPerType[0], nbPerType[1], nbPerType[2]);
+
+        for (auto const& shape : _shapes) {
+            add(shape);
+        }
+    }
+
+    void reserve(std::size_t _nbCircles, std::size_t _nbSquares, std::size_t _nbTriangles)
+    {
+        m_circleRadii.reserve(_nbCircles);
+        m_circleCenters.reserve(_nbCircles);
+        m_squareSides.reserve(_nbSquares);
+        m_squareCenters.reserve(_nbSquares);
+        m_triangleDims.reserve(_nbTriangles);
+        m_triangleCenters.reserve(_nbTriangles);
+    }
+
+    void add(Circle const& _circle)
+    {
+        m_circleRadii.push_back(_circle.radius());
+        m_circleCenters.push_back(_circle.center());
+    }
+
+    void add(Square const& _square)
+    {
+        m_squareSides.push_back(_square.side());
+        m_squareCenters.push_back(_square.center());
+    }
+
+    void add(Triangle const& _triangle)
+    {
+        m_triangleDims.push_back({ _triangle.base(), _triangle.height() });
+        m_triangleCenters.push_back(_triangle.center());
+    }
+
+    void add(Shape const& _shape)
+    {
+        std::visit([this](auto const& _s) { add(_s); }, _shape);
+    }
+
+    std::size_t size() const { return m_circleRadii.size() + m_squareSides.size() + m_triangleDims.size(); }
+
+    // memory allocated by the columns, in bytes
+    std::size_t memoryBytes() const
+    {
+        return m_circleRadii.capacity() * sizeof(double) + m_circleCenters.capacity() * sizeof(Point)
+             + m_squareSides.capacity() * sizeof(double) + m_squareCenters.capacity() * sizeof(Point)
+             + m_triangleDims.capacity() * sizeof(BaseHeight) + m_triangleCenters.capacity() * sizeof(Point);
+    }
+
+    std::span<const double>     circleRadii()     const { return m_circleRadii; }
+    std::span<const Point>      circleCenters()   const { return m_circleCenters; }
+    std::span<const double>     squareSides()     const { return m_squareSides; }
+    std::span<const Point>      squareCenters()   const { return m_squareCenters; }
+    std::span<const BaseHeight> triangleDims()    const { return m_triangleDims; }
+    std::span<const Point>      triangleCenters() const { return m_triangleCenters; }
+
+    ShapeColumns columns() const
+    {
+        return { m_circleRadii, m_circleCenters, m_squareSides, m_squareCenters, m_triangleDims, m_triangleCenters };
+    }
+
+    // applies _visitor on all Circles, then all Squares, then all Triangles,
+    // and passes the value returned by each call (if any) to _sink
+    template< typename Visitor, typename Sink >
+    void visit(Visitor&& _visitor, Sink&& _sink) const
+    {
+        columns().visit(_visitor, _sink);
+    }
+
+    template< typename Visitor >
+    void visit(Visitor&& _visitor) const
+    {
+        columns().visit(_visitor);
+    }
+
+    // batch computation of all the areas, in the same order as visit()
+    // (_areas must hold at least size() values)
+    void areas(AreaVisitor const& _visitor, std::span<double> _areas) const
+    {
+        columns().areas(_visitor, _areas);
+    }
+
+private:
+
+    std::vector<double>     m_circleRadii;
+    std::vector<Point>      m_circleCenters;
+    std::vector<double>     m_squareSides;
+    std::vector<Point>      m_squareCenters;
+    std::vector<BaseHeight> m_triangleDims;
+    std::vector<Point>      m_triangleCenters;
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                    SHAPEFILE                                                |
++------------------------------------------------------------------------------------------------------------*/
+
+// Binary file format for shape collections: the columns of a ShapeStore, as is.
+// Layout (native endianness, every value 8-byte aligned):
+//   ShapeFileHeader
+//   circle radii       double     x nbCircles
+//   circle centers     Point      x nbCircles
+//   square sides       double     x nbSquares
+//   square centers     Point      x nbSquares
+//   triangle dims      BaseHeight x nbTriangles
+//   triangle centers   Point      x nbTriangles
+// A mapped file is used in place: no parsing, no copy.
+
+constexpr char          shapeFileMagic[8] = { 'S', 'H', 'A', 'P', 'E', 'S', '\0', '\0' };
+constexpr std::uint32_t shapeFileVersion = 1;
+constexpr std::uint32_t shapeFileEndianTag = 0x01020304;  // read back differently on a foreign-endian machine
+
+struct ShapeFileHeader
+{
+    char          magic[8];
+    std::uint32_t version;
+    std::uint32_t endianTag;
+    std::uint64_t nbCircles;
+    std::uint64_t nbSquares;
+    std::uint64_t nbTriangles;
+};
+
+static_assert(sizeof(ShapeFileHeader) % alignof(double) == 0, "columns must stay aligned after the header");
+static_assert(sizeof(Point) == 2 * sizeof(double) && sizeof(BaseHeight) == 2 * sizeof(double), "unexpected padding");
+
+// checks that the counts of _header describe exactly _fileSize bytes
+// (each count is bounded by the remaining size first, so crafted counts cannot overflow)
+bool shapeFileMatchesSize(ShapeFileHeader const& _header, std::uint64_t _fileSize)
+{
+    if (_fileSize < sizeof(ShapeFileHeader)) {
+        return false;
+    }
 
-        std::visit(PrintVisitor(), shape);
+    const std::uint64_t columns[3][2] = {
+        { _header.nbCircles,   sizeof(double) + sizeof(Point) },
+        { _header.nbSquares,   sizeof(double) + sizeof(Point) },
+        { _header.nbTriangles, sizeof(BaseHeight) + sizeof(Point) }
+    };
+
+    std::uint64_t remaining = _fileSize - sizeof(ShapeFileHeader);
+    for (auto const& [count, recordSize] : columns)
+    {
+        if (count > remaining / recordSize) {
+            return false;
+        }
+        remaining -= count * recordSize;
+    }
+    return remaining == 0;
+}
 
-        std::cout << "area = " <<  std::visit(AreaVisitor(2.0), shape) << std::endl;
+// writes _columns into a shape file; returns false on failure
+bool writeShapeFile(std::filesystem::path const& _path, ShapeColumns const& _columns)
+{
+    std::ofstream file(_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
     }
+
+    ShapeFileHeader header{};
+    std::memcpy(header.magic, shapeFileMagic, sizeof(header.magic));
+    header.version = shapeFileVersion;
+    header.endianTag = shapeFileEndianTag;
+    header.nbCircles = _columns.circleRadii.size();
+    header.nbSquares = _columns.squareSides.size();
+    header.nbTriangles = _columns.triangleDims.size();
+
+    auto write = [&file](auto _column) {
+        file.write(reinterpret_cast<char const*>(_column.data()), std::streamsize(_column.size_bytes()));
+    };
+    write(std::span<const ShapeFileHeader>(&header, 1));
+    write(_columns.circleRadii);
+    write(_columns.circleCenters);
+    write(_columns.squareSides);
+    write(_columns.squareCenters);
+    write(_columns.triangleDims);
+    write(_columns.triangleCenters);
+
+    return bool(file.flush());
 }
 
 
-int main()
+// Read-only memory mapping of a shape file, visited in place
+class MappedShapeFile
 {
-   Shapes shapes{};
+public:
+    MappedShapeFile() = default;
 
-   shapes.emplace_back( Circle( 2.3 ) );
-   shapes.emplace_back( Square( 1.2 ) );
-   shapes.emplace_back( Circle( 4.1 ) );
-   shapes.emplace_back( Triangle( 2.1, 1.2 ) );
+    ~MappedShapeFile() { close(); }
 
-   visitAllShapes( shapes );
+    MappedShapeFile(MappedShapeFile const&) = delete;
+    MappedShapeFile& operator=(MappedShapeFile const&) = delete;
+
+    // maps the file and checks its header; returns false if it is not a valid shape file
+    bool open(std::filesystem::path const& _path)
+    {
+        close();
+        if (!map(_path)) {
+            return false;
+        }
+
+        ShapeFileHeader header;
+        if (m_size < sizeof(header)) {
+            close();
+            return false;
+        }
+        std::memcpy(&header, m_data, sizeof(header));
+        if (std::memcmp(header.magic, shapeFileMagic, sizeof(header.magic)) != 0
+            || header.version != shapeFileVersion
+            || header.endianTag != shapeFileEndianTag
+            || !shapeFileMatchesSize(header, m_size))
+        {
+            close();
+            return false;
+        }
+
+        // columns point directly into the mapped pages
+        char const* ptr = static_cast<char const*>(m_data) + sizeof(header);
+        m_columns.circleRadii     = takeColumn<double>(ptr, header.nbCircles);
+        m_columns.circleCenters   = takeColumn<Point>(ptr, header.nbCircles);
+        m_columns.squareSides     = takeColumn<double>(ptr, header.nbSquares);
+        m_columns.squareCenters   = takeColumn<Point>(ptr, header.nbSquares);
+        m_columns.triangleDims    = takeColumn<BaseHeight>(ptr, header.nbTriangles);
+        m_columns.triangleCenters = takeColumn<Point>(ptr, header.nbTriangles);
+        return true;
+    }
+
+    void close()
+    {
+        if (m_data != nullptr) {
+            unmap();
+        }
+        m_data = nullptr;
+        m_size = 0;
+        m_columns = {};
+    }
+
+    bool isOpen() const { return m_data != nullptr; }
+
+    std::size_t size() const { return m_columns.size(); }
+    ShapeColumns const& columns() const { return m_columns; }
+
+    template< typename Visitor, typename Sink >
+    void visit(Visitor&& _visitor, Sink&& _sink) const
+    {
+        m_columns.visit(_visitor, _sink);
+    }
+
+    template< typename Visitor >
+    void visit(Visitor&& _visitor) const
+    {
+        m_columns.visit(_visitor);
+    }
+
+    void areas(AreaVisitor const& _visitor, std::span<double> _areas) const
+    {
+        m_columns.areas(_visitor, _areas);
+    }
+
+private:
+
+    // returns the column starting at _ptr, and moves _ptr to the next one
+    template< typename T >
+    static std::span<const T> takeColumn(char const*& _ptr, std::uint64_t _size)
+    {
+        std::span<const T> column(reinterpret_cast<T const*>(_ptr), std::size_t(_size));
+        _ptr += column.size_bytes();
+        return column;
+    }
+
+#ifdef _WIN32
+    bool map(std::filesystem::path const& _path)
+    {
+        HANDLE file = CreateFileW(_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        HANDLE mapping = nullptr;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+            mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        }
+        if (mapping != nullptr) {
+            m_data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            m_size = m_data ? std::size_t(size.QuadPart) : 0;
+            CloseHandle(mapping);  // the view keeps the mapping alive
+        }
+        CloseHandle(file);
+        return m_data != nullptr;
+    }
+
+    void unmap() { UnmapViewOfFile(m_data); }
+#else
+    bool map(std::filesystem::path const& _path)
+    {
+        int fd = ::open(_path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void* data = mmap(nullptr, std::size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                m_data = data;
+                m_size = std::size_t(info.st_size);
+            }
+        }
+        ::close(fd);  // the mapping stays valid
+        return m_data != nullptr;
+    }
+
+    void unmap() { munmap(const_cast<void*>(m_data), m_size); }
+#endif
+
+    void const* m_data = nullptr;
+    std::size_t m_size = 0;
+    ShapeColumns m_columns;
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                  GROUPEDSHAPES                                              |
++------------------------------------------------------------------------------------------------------------*/
+
+// Shapes stored grouped by type: one contiguous std::vector per alternative of Shape.
+// Each group is visited with a statically known type: no per-element std::visit dispatch,
+// no index indirection and no type check, and the shapes are read at their own size (not the variant's).
+// Each shape keeps a stable index (returned by add()); inside a group the shapes stay in ascending index order.
+// Removals compact the affected groups in one ordered pass, so batch them with remove(span) when possible.
+class GroupedShapes
+{
+public:
+    static constexpr std::size_t nbTypes = std::variant_size_v<Shape>;
+
+    GroupedShapes() = default;
+
+    explicit GroupedShapes(Shapes const& _shapes)
+    {
+        m_slots.reserve(_shapes.size());
+        for (auto const& shape : _shapes) {
+            add(shape);
+        }
+    }
+
+    // appends a shape and returns its index (the largest so far: groups stay sorted)
+    std::size_t add(Shape const& _shape)
+    {
+        return std::visit([this](auto const& _concreteShape) { return add(_concreteShape); }, _shape);
+    }
+
+    template< typename ShapeT >
+    std::size_t add(ShapeT const& _shape)
+    {
+        constexpr std::size_t type = typeIndex<ShapeT>();
+        auto& group = std::get<type>(m_groups);
+        const std::size_t index = m_slots.size();
+        m_slots.push_back({ static_cast<std::uint8_t>(type), group.shapes.size() });
+        group.shapes.push_back(_shape);
+        group.indices.push_back(index);
+        ++m_size;
+        return index;
+    }
+
+    // removes the shapes at _indices (in any order); the other shapes keep their index.
+    // O(size of the affected groups), from the first removed position of each
+    void remove(std::span<const std::size_t> _indices)
+    {
+        std::array<std::size_t, nbTypes> firstPosition;
+        firstPosition.fill(std::numeric_limits<std::size_t>::max());
+        for (std::size_t index : _indices)
+        {
+            assert(contains(index));
+            Slot& slot = m_slots[index];
+            firstPosition[slot.type] = std::min(firstPosition[slot.type], slot.position);
+            slot.type = removedType;
+            --m_size;
+        }
+        forEachType([&]<std::size_t Type>() {
+            if (firstPosition[Type] != std::numeric_limits<std::size_t>::max()) {
+                compactGroup<Type>(firstPosition[Type]);
+            }
+        });
+    }
+
+    void remove(std::size_t _index)
+    {
+        remove(std::span<const std::size_t>(&_index, 1));
+    }
+
+    // replaces the shape at _index (its type may change)
+    void replace(std::size_t _index, Shape const& _shape)
+    {
+        assert(contains(_index));
+        const Slot slot = m_slots[_index];
+        if (_shape.index() == slot.type)
+        {
+            forEachType([&]<std::size_t Type>() {
+                if (Type == slot.type) {
+                    std::get<Type>(m_groups).shapes[slot.position] = *std::get_if<Type>(&_shape);
+                }
+            });
+            return;
+        }
+
+        m_slots[_index].type = removedType;
+        forEachType([&]<std::size_t Type>() {
+            if (Type == slot.type) {
+                compactGroup<Type>(slot.position);
+            }
+            else if (Type == _shape.index()) {
+                insertInGroup<Type>(_index, *std::get_if<Type>(&_shape));
+            }
+        });
+    }
+
+    // renumbers the shapes contiguously, in index order (invalidates the indices)
+    void compact()
+    {
+        Shapes shapes = this->shapes();
+        *this = GroupedShapes(shapes);
+    }
+
+    std::size_t size() const { return m_size; }
+
+    // number of slots, removed ones included: valid indices are in [0, nbSlots())
+    std::size_t nbSlots() const { return m_slots.size(); }
+
+    bool contains(std::size_t _index) const { return _index < m_slots.size() && m_slots[_index].type != removedType; }
+
+    // copy of the shape at _index
+    Shape shape(std::size_t _index) const
+    {
+        assert(contains(_index));
+        std::optional<Shape> result;   // Shape has no default constructor
+        const Slot slot = m_slots[_index];
+        forEachType([&]<std::size_t Type>() {
+            if (Type == slot.type) {
+                result.emplace(std::in_place_index<Type>, std::get<Type>(m_groups).shapes[slot.position]);
+            }
+        });
+        return *result;
+    }
+
+    // copy of all the shapes, in index order
+    Shapes shapes() const
+    {
+        Shapes result;
+        result.reserve(m_size);
+        for (std::size_t index = 0; index < m_slots.size(); ++index) {
+            if (contains(index)) {
+                result.push_back(shape(index));
+            }
+        }
+        return result;
+    }
+
+    // applies _visitor on all Circles, then all Squares, then all Triangles, each in ascending index order,
+    // and passes the value returned by each call (if any) to _sink
+    template< typename Visitor, typename Sink >
+    void visitGrouped(Visitor&& _visitor, Sink&& _sink) const
+    {
+        forEachType([&]<std::size_t Type>() {
+            for (auto const& shape : std::get<Type>(m_groups).shapes)
+            {
+                if constexpr (std::is_void_v< decltype(_visitor(shape)) >) {
+                    _visitor(shape);
+                }
+                else {
+                    _sink(_visitor(shape));
+                }
+            }
+        });
+    }
+
+    template< typename Visitor >
+    void visitGrouped(Visitor&& _visitor) const
+    {
+        visitGrouped(_visitor, [](auto&&...) {});
+    }
+
+private:
+
+    static constexpr std::uint8_t removedType = std::numeric_limits<std::uint8_t>::max();
+    static_assert(nbTypes < removedType);
+
+    // where the shape of an index is stored
+    struct Slot
+    {
+        std::uint8_t type;       // alternative of Shape, removedType if removed
+        std::size_t  position;   // position in its group
+    };
+
+    template< typename ShapeT >
+    struct Group
+    {
+        std::vector<ShapeT>      shapes;
+        std::vector<std::size_t> indices;   // index of each shape, ascending
+    };
+
+    template< typename Variant >
+    struct GroupsOf;
+
+    template< typename... ShapeTs >
+    struct GroupsOf< std::variant<ShapeTs...> >
+    {
+        using type = std::tuple< Group<ShapeTs>... >;
+    };
+
+    template< typename ShapeT, std::size_t Type = 0 >
+    static constexpr std::size_t typeIndex()
+    {
+        if constexpr (std::is_same_v< ShapeT, std::variant_alternative_t<Type, Shape> >) {
+            return Type;
+        }
+        else {
+            return typeIndex<ShapeT, Type + 1>();
+        }
+    }
+
+    // calls _fn.template operator()<Type>() for each alternative of Shape
+    template< typename Fn >
+    static void forEachType(Fn&& _fn)
+    {
+        [&]<std::size_t... Types>(std::index_sequence<Types...>) {
+            (_fn.template operator()<Types>(), ...);
+        }(std::make_index_sequence<nbTypes>{});
+    }
+
+    // removes from group Type the shapes whose slot is not of this type anymore, keeping the order
+    // (nothing before _first is affected)
+    template< std::size_t Type >
+    void compactGroup(std::size_t _first)
+    {
+        auto& group = std::get<Type>(m_groups);
+        std::size_t kept = _first;
+        for (std::size_t position = _first; position < group.shapes.size(); ++position)
+        {
+            const std::size_t index = group.indices[position];
+            if (m_slots[index].type != Type) {
+                continue;
+            }
+            if (kept != position) {
+                group.shapes[kept] = group.shapes[position];
+                group.indices[kept] = index;
+            }
+            m_slots[index].position = kept;
+            ++kept;
+        }
+        group.shapes.erase(group.shapes.begin() + std::ptrdiff_t(kept), group.shapes.end());
+        group.indices.resize(kept);
+    }
+
+    // inserts _shape in group Type at its ordered position
+    template< std::size_t Type >
+    void insertInGroup(std::size_t _index, std::variant_alternative_t<Type, Shape> const& _shape)
+    {
+        auto& group = std::get<Type>(m_groups);
+        auto it = std::lower_bound(group.indices.begin(), group.indices.end(), _index);
+        const std::size_t position = std::size_t(it - group.indices.begin());
+        group.indices.insert(it, _index);
+        group.shapes.insert(group.shapes.begin() + std::ptrdiff_t(position), _shape);
+
+        m_slots[_index] = { static_cast<std::uint8_t>(Type), position };
+        for (std::size_t p = position + 1; p < group.indices.size(); ++p) {
+            m_slots[group.indices[p]].position = p;
+        }
+    }
+
+    std::vector<Slot> m_slots;           // per index
+    GroupsOf<Shape>::type m_groups;      // shapes, per type
+    std::size_t m_size = 0;
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                   SPATIALGRID                                               |
++------------------------------------------------------------------------------------------------------------*/
+
+// Uniform grid over shape centers, to find the shapes in a region without scanning all of them.
+// Each shape is stored (by id, e.g., its index in Shapes) in the cell containing its center,
+// and queries are enlarged by the largest extent inserted so far, so that overlapping shapes are not missed.
+// Only the occupied cells are allocated (hash map), so the world does not need to be bounded.
+class SpatialGrid
+{
+public:
+    using Id = std::size_t;
+
+    // _cellSize should be in the order of the typical query size
+    explicit SpatialGrid(double _cellSize)
+        : m_cellSize(_cellSize)
+    {}
+
+    // adds a shape, given its center and the half size of its bounding box (see ExtentVisitor)
+    void insert(Id _id, Point _center, Point _halfSize)
+    {
+        if (_id >= m_entries.size()) {
+            m_entries.resize(_id + 1);
+        }
+        Entry& entry = m_entries[_id];
+        if (entry.isUsed) {
+            remove(_id);
+        }
+
+        const std::uint64_t key = cellKey(cellCoord(_center.x), cellCoord(_center.y));
+        auto& cell = m_cells[key];
+        entry = { _center, _halfSize, key, cell.size(), true };
+        cell.push_back(_id);
+
+        m_maxHalfSize.x = std::max(m_maxHalfSize.x, _halfSize.x);
+        m_maxHalfSize.y = std::max(m_maxHalfSize.y, _halfSize.y);
+        m_size++;
+    }
+
+    void insert(Id _id, Shape const& _shape)
+    {
+        insert(_id, std::visit([](auto const& _s) { return _s.center(); }, _shape), std::visit(ExtentVisitor(), _shape));
+    }
+
+    void remove(Id _id)
+    {
+        if (!contains(_id)) {
+            return;
+        }
+        Entry& entry = m_entries[_id];
+        auto cellIt = m_cells.find(entry.cell);
+        auto& cell = cellIt->second;
+
+        // the last id of the cell takes the place of the removed one
+        cell[entry.slot] = cell.back();
+        m_entries[cell.back()].slot = entry.slot;
+        cell.pop_back();
+        if (cell.empty()) {
+            m_cells.erase(cellIt);
+        }
+
+        entry.isUsed = false;
+        m_size--;
+    }
+
+    bool contains(Id _id) const { return _id < m_entries.size() && m_entries[_id].isUsed; }
+    std::size_t size() const { return m_size; }
+
+    // ids of the shapes whose bounding box overlaps the rectangle [_min, _max] (in _result, cleared first)
+    void queryRect(Point _min, Point _max, std::vector<Id>& _result) const
+    {
+        _result.clear();
+        forEachCandidate(_min, _max, [&](Id _id, Entry const& _e) {
+            if (_e.center.x + _e.halfSize.x >= _min.x && _e.center.x - _e.halfSize.x <= _max.x &&
+                _e.center.y + _e.halfSize.y >= _min.y && _e.center.y - _e.halfSize.y <= _max.y) {
+                _result.push_back(_id);
+            }
+        });
+    }
+
+    // ids of the shapes whose bounding box overlaps the disk (_center, _radius) (in _result, cleared first)
+    void queryRadius(Point _center, double _radius, std::vector<Id>& _result) const
+    {
+        _result.clear();
+        forEachCandidate({ _center.x - _radius, _center.y - _radius }, { _center.x + _radius, _center.y + _radius },
+            [&](Id _id, Entry const& _e) {
+                // distance from the disk center to the bounding box
+                double dx = std::max(std::abs(_center.x - _e.center.x) - _e.halfSize.x, 0.0);
+                double dy = std::max(std::abs(_center.y - _e.center.y) - _e.halfSize.y, 0.0);
+                if (dx * dx + dy * dy <= _radius * _radius) {
+                    _result.push_back(_id);
+                }
+            });
+    }
+
+    // id of the shape whose center is the nearest to _point (none if the grid is empty)
+    std::optional<Id> nearest(Point _point) const
+    {
+        std::optional<Id> best;
+        double bestDist2 = std::numeric_limits<double>::max();
+        auto consider = [&](std::vector<Id> const& _cell) {
+            for (Id id : _cell)
+            {
+                double dx = m_entries[id].center.x - _point.x;
+                double dy = m_entries[id].center.y - _point.y;
+                if (dx * dx + dy * dy < bestDist2) {
+                    bestDist2 = dx * dx + dy * dy;
+                    best = id;
+                }
+            }
+        };
+
+        // search rings of cells around the point; after ring k, unvisited centers are at least k cells away
+        const std::int64_t cx = cellCoord(_point.x);
+        const std::int64_t cy = cellCoord(_point.y);
+        for (std::int64_t k = 0; m_size > 0; ++k)
+        {
+            // rings larger than the set of occupied cells: scan the occupied cells instead
+            if (std::uint64_t((2 * k + 1) * (2 * k + 1)) > 4 * m_cells.size())
+            {
+                for (auto const& [key, cell] : m_cells) {
+                    consider(cell);
+                }
+                break;
+            }
+
+            for (std::int64_t y = cy - k; y <= cy + k; ++y)
+            {
+                // full rows at the top and bottom of the ring, only both ends in between
+                const std::int64_t step = (y == cy - k || y == cy + k) ? 1 : std::max<std::int64_t>(2 * k, 1);
+                for (std::int64_t x = cx - k; x <= cx + k; x += step)
+                {
+                    auto cellIt = m_cells.find(cellKey(x, y));
+                    if (cellIt != m_cells.end()) {
+                        consider(cellIt->second);
+                    }
+                }
+            }
+
+            const double reached = double(k) * m_cellSize;
+            if (best && bestDist2 <= reached * reached) {
+                break;
+            }
+        }
+        return best;
+    }
+
+private:
+
+    struct Entry
+    {
+        Point center{};
+        Point halfSize{};
+        std::uint64_t cell = 0;  // key of the cell containing the center
+        std::size_t slot = 0;    // position in that cell
+        bool isUsed = false;
+    };
+
+    std::int64_t cellCoord(double _coord) const
+    {
+        return std::int64_t(std::floor(_coord / m_cellSize));
+    }
+
+    // cell coordinates are truncated to 32 bits each
+    static std::uint64_t cellKey(std::int64_t _x, std::int64_t _y)
+    {
+        return (std::uint64_t(std::uint32_t(_x)) << 32) | std::uint64_t(std::uint32_t(_y));
+    }
+
+    // calls _fn(id, entry) for every shape whose center lies in the cells covering [_min, _max],
+    // enlarged by the largest extent
+    template< typename Fn >
+    void forEachCandidate(Point _min, Point _max, Fn&& _fn) const
+    {
+        const std::int64_t x0 = cellCoord(_min.x - m_maxHalfSize.x), x1 = cellCoord(_max.x + m_maxHalfSize.x);
+        const std::int64_t y0 = cellCoord(_min.y - m_maxHalfSize.y), y1 = cellCoord(_max.y + m_maxHalfSize.y);
+
+        // more cells in the range than occupied cells: iterate over the occupied cells
+        if (double(x1 - x0 + 1) * double(y1 - y0 + 1) > double(m_cells.size()))
+        {
+            for (auto const& [key, cell] : m_cells) {
+                for (Id id : cell) {
+                    _fn(id, m_entries[id]);
+                }
+            }
+            return;
+        }
+
+        for (std::int64_t y = y0; y <= y1; ++y)
+        {
+            for (std::int64_t x = x0; x <= x1; ++x)
+            {
+                auto cellIt = m_cells.find(cellKey(x, y));
+                if (cellIt == m_cells.end()) {
+                    continue;
+                }
+                for (Id id : cellIt->second) {
+                    _fn(id, m_entries[id]);
+                }
+            }
+        }
+    }
+
+    double m_cellSize;
+    std::unordered_map< std::uint64_t, std::vector<Id> > m_cells;  // occupied cells only
+    std::vector<Entry> m_entries;                                  // indexed by id
+    Point m_maxHalfSize{ 0.0, 0.0 };                                // never decreases on removal (conservative)
+    std::size_t m_size = 0;
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                 CACHEDAGGREGATE                                             |
++------------------------------------------------------------------------------------------------------------*/
+
+// Shapes with the cached result of a visitor for each shape (e.g., AreaVisitor), and the running total.
+// Shapes are only modified through the tracked API below, which marks them dirty,
+// and refresh() recomputes the dirty entries only: its cost depends on the number of changes, not on the scene size.
+// (the total is updated by differences: call rebuildTotal() from time to time to drop accumulated rounding errors)
+template< typename Visitor >
+class CachedAggregate
+{
+public:
+    using Result = decltype( std::visit( std::declval<Visitor const&>(), std::declval<Shape const&>() ) );
+
+    explicit CachedAggregate(Visitor _visitor, Shapes _shapes = {})
+        : m_visitor(std::move(_visitor)), m_shapes(std::move(_shapes)),
+          m_results(m_shapes.size()), m_isDirty(m_shapes.size(), true)
+    {
+        m_dirty.reserve(m_shapes.size());
+        for (std::size_t i = 0; i < m_shapes.size(); ++i) {
+            m_dirty.push_back(i);
+        }
+    }
+
+    // appends a shape and returns its index
+    std::size_t add(Shape const& _shape)
+    {
+        m_shapes.push_back(_shape);
+        m_results.push_back(Result{});
+        m_isDirty.push_back(false);
+        markDirty(m_shapes.size() - 1);
+        return m_shapes.size() - 1;
+    }
+
+    // removes the shape at _index: the last shape is moved in its place (and thus changes index)
+    void remove(std::size_t _index)
+    {
+        markDirty(_index);  // removes its result from the total
+
+        const std::size_t last = m_shapes.size() - 1;
+        if (_index != last)
+        {
+            m_shapes[_index] = std::move(m_shapes[last]);
+            m_results[_index] = m_results[last];
+            m_isDirty[_index] = m_isDirty[last];
+            if (m_isDirty[_index]) {
+                m_dirty.push_back(_index);
+            }
+        }
+        m_shapes.pop_back();
+        m_results.pop_back();
+        m_isDirty.pop_back();
+    }
+
+    void replace(std::size_t _index, Shape const& _shape)
+    {
+        markDirty(_index);
+        m_shapes[_index] = _shape;
+    }
+
+    // calls _fn(Shape&) to modify the shape at _index in place
+    template< typename Fn >
+    void modify(std::size_t _index, Fn&& _fn)
+    {
+        markDirty(_index);
+        _fn(m_shapes[_index]);
+    }
+
+    // recomputes the results of the shapes modified since the last call
+    void refresh()
+    {
+        for (std::size_t index : m_dirty)
+        {
+            // indices may be stale after removals, or listed twice
+            if (index >= m_shapes.size() || !m_isDirty[index]) {
+                continue;
+            }
+            m_results[index] = std::visit(m_visitor, m_shapes[index]);
+            m_total = m_total + m_results[index];
+            m_isDirty[index] = false;
+        }
+        m_dirty.clear();
+    }
+
+    // recomputes the total from the cached results
+    void rebuildTotal()
+    {
+        refresh();
+        m_total = Result{};
+        for (auto const& result : m_results) {
+            m_total = m_total + result;
+        }
+    }
+
+    std::size_t size() const { return m_shapes.size(); }
+    std::size_t nbDirty() const { return m_dirty.size(); }  // upper bound (may count removed shapes)
+    Shapes const& shapes() const { return m_shapes; }
+
+    // results are up to date after refresh()
+    Result const& result(std::size_t _index) const { return m_results[_index]; }
+    Result const& total() const { return m_total; }
+
+private:
+
+    void markDirty(std::size_t _index)
+    {
+        if (m_isDirty[_index]) {
+            return;
+        }
+        m_total = m_total - m_results[_index];
+        m_isDirty[_index] = true;
+        m_dirty.push_back(_index);
+    }
+
+    Visitor m_visitor;
+    Shapes m_shapes;
+    std::vector<Result> m_results;
+    std::vector<char> m_isDirty;
+    std::vector<std::size_t> m_dirty;  // indices to recompute
+    Result m_total{};
+};
+
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                   FUSEDVISITOR                                              |
++------------------------------------------------------------------------------------------------------------*/
+
+// value returned by a visitor inside a FusedVisitor (std::monostate for visitors returning nothing)
+template< typename Visitor >
+using FusedResult = std::conditional_t<
+    std::is_void_v< decltype( std::visit( std::declval<Visitor&>(), std::declval<Shape const&>() ) ) >,
+    std::monostate,
+    decltype( std::visit( std::declval<Visitor&>(), std::declval<Shape const&>() ) ) >;
+
+// Combines several visitors into one: a single std::visit per shape calls all of them (in order)
+// on the same alternative, and returns their results as a tuple
+template< typename... Visitors >
+class FusedVisitor
+{
+public:
+    explicit FusedVisitor(Visitors... _visitors)
+        : m_visitors(std::move(_visitors)...)
+    {}
+
+    template< typename ShapeT >
+    std::tuple< FusedResult<Visitors>... > operator()(ShapeT const& _shape)
+    {
+        // braced initialization: the visitors are called from left to right
+        return std::apply([&_shape](auto&... _visitor) {
+            return std::tuple< FusedResult<Visitors>... >{ call(_visitor, _shape)... };
+        }, m_visitors);
+    }
+
+private:
+
+    template< typename Visitor, typename ShapeT >
+    static auto call(Visitor& _visitor, ShapeT const& _shape)
+    {
+        if constexpr (std::is_void_v< decltype(_visitor(_shape)) >) {
+            _visitor(_shape);
+            return std::monostate{};
+        }
+        else {
+            return _visitor(_shape);
+        }
+    }
+
+    std::tuple<Visitors...> m_visitors;
+};
+
+// outputs of visitors returning nothing stay empty
+template< typename Result >
+void reserveFusedOutput(std::vector<Result>& _output, std::size_t _size)
+{
+    if constexpr (!std::is_same_v<Result, std::monostate>) {
+        _output.reserve(_size);
+    }
+}
+
+template< typename Result >
+void appendFusedResult(std::vector<Result>& _output, Result&& _result)
+{
+    if constexpr (!std::is_same_v<Result, std::monostate>) {
+        _output.push_back(std::move(_result));
+    }
+}
+
+// Runs all the visitors in a single pass over _shapes (one dispatch per shape),
+// and returns the values returned by each visitor in its own vector (empty for visitors returning nothing)
+template< typename... Visitors >
+std::tuple< std::vector< FusedResult<Visitors> >... > visitFused( Shapes const& _shapes, Visitors... _visitors )
+{
+    FusedVisitor<Visitors...> fused(std::move(_visitors)...);
+    std::tuple< std::vector< FusedResult<Visitors> >... > outputs;
+
+    std::apply([&_shapes](auto&... _output) { (reserveFusedOutput(_output, _shapes.size()), ...); }, outputs);
+
+    for (auto const& shape : _shapes)
+    {
+        auto results = std::visit(fused, shape);
+        [&]<std::size_t... Is>(std::index_sequence<Is...>) {
+            (appendFusedResult(std::get<Is>(outputs), std::move(std::get<Is>(results))), ...);
+        }(std::index_sequence_for<Visitors...>{});
+    }
+    return outputs;
+}
+
+/*------------------------------------------------------------------------------------------------------------+
+|                                                      MAIN                                                   |
++------------------------------------------------------------------------------------------------------------*/
+
+void visitAllShapes( Shapes const& _shapes )
+{
+    // both visitors are applied with a single dispatch per shape
+    FusedVisitor printAndArea( PrintVisitor(), AreaVisitor(2.0) );
+
+    for (auto const& shape : _shapes)
+    {
+        // std::visit calls a callable (visitor) onto a variant (shape)
+        // https://en.cppreference.com/w/cpp/utility/variant/visit
+
+        auto results = std::visit(printAndArea, shape);
+
+        std::cout << "area = " << std::get<1>(results) << std::endl;
+    }
+}
+
+// Chunks have a fixed size, independent of the number of threads: each chunk is reduced sequentially,
+// then the partial results are combined in chunk order, so the result is identical on every run
+// and for any number of threads.
+constexpr std::size_t visitChunkSize = 4096;
+
+// applies _visitor on all shapes using _nbThreads worker threads (0: one per hardware thread),
+// and returns the values returned by the visitor combined with _reduce (if the visitor returns a value)
+// (_visitor is shared by all threads, so it must be safe to call concurrently)
+template< typename Visitor, typename Reduce = std::plus<> >
+auto visitAllShapesParallel( Shapes const& _shapes, Visitor const& _visitor, unsigned _nbThreads = 0, Reduce _reduce = {} )
+{
+    using Result = decltype( std::visit( _visitor, std::declval<Shape const&>() ) );
+    constexpr bool hasResult = !std::is_void_v<Result>;
+
+    const std::size_t nbChunks = (_shapes.size() + visitChunkSize - 1) / visitChunkSize;
+    if (_nbThreads == 0) {
+        _nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    _nbThreads = static_cast<unsigned>( std::min<std::size_t>(_nbThreads, std::max<std::size_t>(nbChunks, 1)) );
+
+    // one partial result per chunk, wrapped so that std::vector<bool> never packs them into shared words
+    struct Partial { std::conditional_t<hasResult, Result, char> value; };
+    std::vector<Partial> partials(hasResult ? nbChunks : 0);
+
+    auto visitChunk = [&](std::size_t _chunk)
+    {
+        const std::size_t begin = _chunk * visitChunkSize;
+        const std::size_t end = std::min(begin + visitChunkSize, _shapes.size());
+        if constexpr (hasResult)
+        {
+            Result partial = std::visit( _visitor, _shapes[begin] );
+            for (std::size_t i = begin + 1; i < end; ++i) {
+                partial = _reduce( partial, std::visit( _visitor, _shapes[i] ) );
+            }
+            partials[_chunk].value = partial;
+        }
+        else
+        {
+            for (std::size_t i = begin; i < end; ++i) {
+                std::visit( _visitor, _shapes[i] );
+            }
+        }
+    };
+
+    // workers take the next chunk until there is none left
+    std::atomic<std::size_t> nextChunk{ 0 };
+    auto worker = [&]()
+    {
+        for (std::size_t chunk = nextChunk++; chunk < nbChunks; chunk = nextChunk++) {
+            visitChunk(chunk);
+        }
+    };
+
+    {
+        std::vector<std::jthread> threads;
+        for (unsigned t = 1; t < _nbThreads; ++t) {
+            threads.emplace_back(worker);
+        }
+        worker(); // calling thread works too
+    } // joins
+
+    if constexpr (hasResult)
+    {
+        if (partials.empty()) {
+            return Result{};
+        }
+        Result result = partials[0].value;
+        for (std::size_t c = 1; c < partials.size(); ++c) {
+            result = _reduce( result, partials[c].value );
+        }
+        return result;
+    }
+}
+
+// returns the time spent in _fn, in milliseconds
+template< typename Fn >
+double elapsedMs(Fn&& _fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    _fn();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// random mix of Circles, Squares and Triangles
+Shapes randomShapes(std::size_t _nbShapes)
+{
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> type(0, 2);
+    std::uniform_real_distribution<double> dim(0.1, 10.0);
+    std::uniform_real_distribution<double> coord(-1000.0, 1000.0);
+
+    Shapes shapes;
+    shapes.reserve(_nbShapes);
+    for (std::size_t i = 0; i < _nbShapes; ++i)
+    {
+        const Point center{ coord(gen), coord(gen) };
+        switch (type(gen))
+        {
+            case 0:  shapes.emplace_back( Circle( dim(gen), center ) ); break;
+            case 1:  shapes.emplace_back( Square( dim(gen), center ) ); break;
+            default:
+            {
+                const double base = dim(gen);
+                shapes.emplace_back( Triangle( base, dim(gen), center ) );
+                break;
+            }
+        }
+    }
+    return shapes;
+}
+
+
+int main()
+{
+   Shapes shapes{};
+
+   shapes.emplace_back( Circle( 2.3 ) );
+   shapes.emplace_back( Square( 1.2 ) );
+   shapes.emplace_back( Circle( 4.1 ) );
+   shapes.emplace_back( Triangle( 2.1, 1.2 ) );
+
+   visitAllShapes( shapes );
+
+   std::cout << std::endl;
+
+   // same shapes, stored column by column
+   ShapeStore store( shapes );
+   {
+       char buffer[BufferedPrintVisitor::maxLineSize * 4];
+       store.visit( BufferedPrintVisitor(buffer) );
+   }
+
+   double totalArea = 0.0;
+   store.visit( AreaVisitor(2.0), [&totalArea](double _area) { totalArea += _area; } );
+   std::cout << "total area = " << totalArea << std::endl;
+
+   std::cout << std::endl;
+
+   // Shapes vs ShapeStore: memory and AreaVisitor throughput
+   const std::size_t nbShapes = 1'000'000;
+   Shapes manyShapes = randomShapes( nbShapes );
+   ShapeStore manyStore( manyShapes );
+
+   double variantArea = 0.0;
+   double variantMs = elapsedMs([&]() {
+       for (auto const& shape : manyShapes) {
+           variantArea += std::visit(AreaVisitor(2.0), shape);
+       }
+   });
+
+   double storeArea = 0.0;
+   double storeMs = elapsedMs([&]() {
+       manyStore.visit( AreaVisitor(2.0), [&storeArea](double _area) { storeArea += _area; } );
+   });
+
+   std::cout << nbShapes << " shapes" << std::endl;
+   std::cout << "Shapes:     " << double(manyShapes.capacity() * sizeof(Shape)) / nbShapes << " bytes/shape, "
+             << variantMs * 1e6 / nbShapes << " ns/shape (total area = " << variantArea << ")" << std::endl;
+   std::cout << "ShapeStore: " << double(manyStore.memoryBytes()) / nbShapes << " bytes/shape, "
+             << storeMs * 1e6 / nbShapes << " ns/shape (total area = " << storeArea << ")" << std::endl;
+
+   // batch areas, with the kernels selected for this CPU
+   std::vector<double> areas( manyStore.size() );
+   double batchMs = elapsedMs([&]() {
+       manyStore.areas( AreaVisitor(2.0), areas );
+   });
+   double batchArea = 0.0;
+   for (double area : areas) {
+       batchArea += area;
+   }
+   std::cout << "ShapeStore batch (" << areaKernels().name << "): "
+             << batchMs * 1e6 / nbShapes << " ns/shape (total area = " << batchArea << ")" << std::endl;
+
+   // parallel visit: same total area whatever the number of threads
+   for (unsigned nbThreads : { 1u, 2u, std::max(1u, std::thread::hardware_concurrency()) })
+   {
+       double parallelArea = 0.0;
+       double parallelMs = elapsedMs([&]() {
+           parallelArea = visitAllShapesParallel( manyShapes, AreaVisitor(2.0), nbThreads );
+       });
+       std::cout << "Shapes parallel (" << nbThreads << " threads): " << parallelMs * 1e6 / nbShapes
+                 << " ns/shape (total area = " << std::hexfloat << parallelArea << std::defaultfloat << ")" << std::endl;
+   }
+
+   // parallel visit with a bool result: is there any shape larger than 1000?
+   const bool hasLargeShape = visitAllShapesParallel( manyShapes,
+                                                      [](auto const& _shape) { return AreaVisitor(2.0)(_shape) > 1000.0; },
+                                                      0, std::logical_or<>{} );
+   std::cout << "Shapes parallel: " << (hasLargeShape ? "some" : "no") << " shape with an area > 1000" << std::endl;
+
+   // shape file: write the store once, then map it and compute the areas in place
+   const std::filesystem::path shapeFilePath = std::filesystem::temp_directory_path() / "visitor_modern_shapes.bin";
+   if (writeShapeFile( shapeFilePath, manyStore.columns() ))
+   {
+       MappedShapeFile shapeFile;
+       bool isOpen = false;
+       double openMs = elapsedMs([&]() { isOpen = shapeFile.open( shapeFilePath ); });
+       if (isOpen)
+       {
+           std::vector<double> fileAreas( shapeFile.size() );
+           double fileMs = elapsedMs([&]() { shapeFile.areas( AreaVisitor(2.0), fileAreas ); });
+           double fileArea = 0.0;
+           for (double area : fileAreas) {
+               fileArea += area;
+           }
+           std::cout << "MappedShapeFile: " << shapeFile.size() << " shapes mapped in " << openMs << " ms, "
+                     << fileMs * 1e6 / shapeFile.size() << " ns/shape (total area = " << fileArea << ")" << std::endl;
+       }
+       shapeFile.close();
+       std::filesystem::remove( shapeFilePath );
+   }
+
+   // grouped visit, after a few incremental updates (removals batched)
+   GroupedShapes groupedShapes( manyShapes );
+   std::vector<std::size_t> removedIndices;
+   for (std::size_t i = 0; i < 1000; ++i) {
+       removedIndices.push_back( i * 97 );
+   }
+   groupedShapes.remove( removedIndices );
+   for (std::size_t i = 0; i < 1000; ++i) {
+       groupedShapes.add( Circle( 1.0 ) );
+   }
+
+   // baseline: the same shapes in a plain std::vector<Shape>, visited with std::visit
+   const Shapes updatedShapes = groupedShapes.shapes();
+   double sequentialArea = 0.0;
+   double sequentialMs = elapsedMs([&]() {
+       for (auto const& shape : updatedShapes) {
+           sequentialArea += std::visit(AreaVisitor(2.0), shape);
+       }
+   });
+
+   double groupedArea = 0.0;
+   double groupedMs = elapsedMs([&]() {
+       groupedShapes.visitGrouped( AreaVisitor(2.0), [&groupedArea](double _area) { groupedArea += _area; } );
+   });
+
+   std::cout << "GroupedShapes std::visit: " << sequentialMs * 1e6 / groupedShapes.size()
+             << " ns/shape (total area = " << sequentialArea << ")" << std::endl;
+   std::cout << "GroupedShapes grouped:    " << groupedMs * 1e6 / groupedShapes.size()
+             << " ns/shape (total area = " << groupedArea << ")" << std::endl;
+
+   // areas and extents: two passes vs one fused pass
+   double twoPassesMs = elapsedMs([&]() {
+       std::vector<double> passAreas;
+       std::vector<Point> passExtents;
+       passAreas.reserve( manyShapes.size() );
+       passExtents.reserve( manyShapes.size() );
+       for (auto const& shape : manyShapes) {
+           passAreas.push_back( std::visit(AreaVisitor(2.0), shape) );
+       }
+       for (auto const& shape : manyShapes) {
+           passExtents.push_back( std::visit(ExtentVisitor(), shape) );
+       }
+   });
+   std::size_t nbFused = 0;
+   double fusedMs = elapsedMs([&]() {
+       auto [fusedAreas, fusedExtents] = visitFused( manyShapes, AreaVisitor(2.0), ExtentVisitor() );
+       nbFused = fusedAreas.size() + fusedExtents.size();
+   });
+   std::cout << "Area + extent: two passes " << twoPassesMs * 1e6 / nbShapes << " ns/shape, fused "
+             << fusedMs * 1e6 / nbShapes << " ns/shape (" << nbFused << " results)" << std::endl;
+
+   // cached areas: a frame with 100 modified shapes only recomputes those
+   CachedAggregate<AreaVisitor> cachedAreas( AreaVisitor(2.0), manyShapes );
+   double fullMs = elapsedMs([&]() { cachedAreas.refresh(); });
+   for (std::size_t i = 0; i < 100; ++i) {
+       cachedAreas.replace( i * 7919, Square( 1.0 + double(i) ) );
+   }
+   double frameMs = elapsedMs([&]() { cachedAreas.refresh(); });
+   std::cout << "CachedAggregate: full pass " << fullMs << " ms, frame with 100 changes " << frameMs
+             << " ms (total area = " << cachedAreas.total() << ")" << std::endl;
+
+   // viewport query (0.1% of the scene area): spatial grid vs linear scan
+   SpatialGrid grid( 20.0 );
+   for (std::size_t i = 0; i < manyShapes.size(); ++i) {
+       grid.insert( i, manyShapes[i] );
+   }
+   const Point viewMin{ 100.0, 100.0 }, viewMax{ 163.2, 163.2 };
+
+   std::vector<SpatialGrid::Id> inView;
+   double gridMs = elapsedMs([&]() { grid.queryRect( viewMin, viewMax, inView ); });
+
+   std::size_t nbScanned = 0;
+   double scanMs = elapsedMs([&]() {
+       for (auto const& shape : manyShapes)
+       {
+           Point center = std::visit([](auto const& _s) { return _s.center(); }, shape);
+           Point halfSize = std::visit(ExtentVisitor(), shape);
+           if (center.x + halfSize.x >= viewMin.x && center.x - halfSize.x <= viewMax.x &&
+               center.y + halfSize.y >= viewMin.y && center.y - halfSize.y <= viewMax.y) {
+               nbScanned++;
+           }
+       }
+   });
+
+   std::optional<SpatialGrid::Id> closest = grid.nearest( { 0.0, 0.0 } );
+   std::cout << "SpatialGrid: " << inView.size() << " shapes in view in " << gridMs << " ms (linear scan: "
+             << nbScanned << " shapes in " << scanMs << " ms), nearest to origin: #" << closest.value_or(0) << std::endl;
+
+   // dump of all the shapes into a file: PrintVisitor vs BufferedPrintVisitor
+   const std::filesystem::path dumpPath = std::filesystem::temp_directory_path() / "visitor_modern_dump.txt";
+   double printMs = 0.0;
+   {
+       std::ofstream file( dumpPath );
+       std::streambuf* coutBuffer = std::cout.rdbuf( file.rdbuf() );
+       printMs = elapsedMs([&]() {
+           for (auto const& shape : manyShapes) {
+               std::visit( PrintVisitor(), shape );
+           }
+       });
+       std::cout.rdbuf( coutBuffer );
+   }
+   const double dumpMB = double( std::filesystem::file_size(dumpPath) ) / 1e6;
+
+   std::vector<char> printBuffer( 1 << 20 );  // reusable 1 MiB buffer
+   std::size_t nbBlockWrites = 0;
+   double bufferedMs = 0.0;
+   if (std::FILE* file = std::fopen( dumpPath.string().c_str(), "wb" ))
+   {
+       bufferedMs = elapsedMs([&]() {
+           BufferedPrintVisitor printer( printBuffer, file );
+           for (auto const& shape : manyShapes) {
+               std::visit( printer, shape );
+           }
+           printer.flush();
+           nbBlockWrites = printer.nbBlockWrites();
+       });
+       std::fclose( file );
+   }
+   std::filesystem::remove( dumpPath );
+
+   std::cout << "PrintVisitor:         " << dumpMB / (printMs * 1e-3) << " MB/s" << std::endl;
+   std::cout << "BufferedPrintVisitor: " << dumpMB / (bufferedMs * 1e-3) << " MB/s ("
+             << nbBlockWrites << " block writes)" << std::endl;
 
    return EXIT_SUCCESS;
 }